@@ -0,0 +1,349 @@
+// lz77arc: command-line front end to the archive engine, for scripts and batch jobs.
+
+#include "ArchiveCompressor.h"
+#include "ArchiveExtractor.h"
+#include "CodecRegistry.h"
+#include "StreamFrame.h"
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace {
+
+const char* USAGE =
+    "Usage:\n"
+    "  lz77arc compress [options] <file or directory> <archive>\n"
+    "  lz77arc extract [options] <archive> <output directory>\n"
+    "  lz77arc list <archive>\n"
+    "  lz77arc test [options] <archive>\n"
+    "  lz77arc compress-stream [options] [input] [output]     (or -c)\n"
+    "  lz77arc decompress-stream [options] [input] [output]   (or -d)\n"
+    "\n"
+    "Options:\n"
+    "  -t, --threads N       Worker threads (default: one per hardware thread)\n"
+    "  -l, --level N         Compression level 1-9 (default: 4)\n"
+    "  --codec NAME          Block codec: lz77 (default), bwt for text, stored, or\n"
+    "                        lz77-fixed for the 5-byte tokens of older archives\n"
+    "  --filter NAME[:N]     Filter blocks before the codec, in the order given: delta[:N],\n"
+    "                        x86 or records:N; may be repeated\n"
+    "  --auto-tune           Pick match finder settings per file from a sample of it\n"
+    "  --target-speed MBPS   With --auto-tune, the slowest acceptable MB/s per thread\n"
+    "  --base ARCHIVE        Reuse unchanged entries from an earlier archive\n"
+    "  --compare-hashes      With --base, also compare content hashes\n"
+    "  --report FILE         Write the job's statistics as JSON\n"
+    "  --no-resume           Start over instead of resuming an interrupted job\n"
+    "  --max-memory SIZE     Keep buffers within SIZE bytes; K, M and G suffixes are accepted\n"
+    "  -q, --quiet           Don't print progress\n"
+    "\n"
+    "Compress and extract jobs keep a .ckpt file next to their output while they run;\n"
+    "after Ctrl+C or a crash, running the same command again resumes the job.\n"
+    "\n"
+    "The stream commands turn one stream into a stream frame and back, reading and writing\n"
+    "front to back so that they work in pipelines; input and output default to stdin and\n"
+    "stdout, or may be given as -. They take --codec, --filter, -l, -t, --max-memory and\n"
+    "--report, and print their summary to stderr.\n"
+    "\n"
+    "The codecs use the widest SIMD instructions the CPU has; setting LZ77_SIMD to scalar,\n"
+    "sse2 or avx2 limits them, for testing.\n";
+
+// Triggered by SIGINT; the running job notices it and unwinds with JobCancelled
+CancellationToken interrupted;
+
+extern "C" void handleInterrupt(int) {
+    interrupted.cancel();
+}
+
+struct CliOptions {
+    std::string command;
+    std::vector<std::string> arguments;
+    size_t threads = 0;
+    int level = DEFAULT_COMPRESSION_LEVEL;
+    BlockCodec codec = BlockCodec::LZ77Repeat;
+    FilterChain filters;
+    bool autoTune = false;
+    double targetSpeed = 0;
+    std::string baseArchive;
+    bool compareHashes = false;
+    std::string reportFile;
+    bool quiet = false;
+    bool resume = true;
+    size_t maxMemory = 0;
+};
+
+// Byte count with an optional binary K, M or G suffix, as in 512M
+size_t parseSize(const std::string& text) {
+    size_t end = 0;
+    unsigned long long value = std::stoull(text, &end);
+    std::string suffix = text.substr(end);
+    if (suffix == "K" || suffix == "k") {
+        value <<= 10;
+    } else if (suffix == "M" || suffix == "m") {
+        value <<= 20;
+    } else if (suffix == "G" || suffix == "g") {
+        value <<= 30;
+    } else if (!suffix.empty()) {
+        throw std::invalid_argument("Invalid size: " + text);
+    }
+    return static_cast<size_t>(value);
+}
+
+BlockCodec parseCodec(const std::string& name) {
+    const Codec* codec = findCodec(name);
+    if (!codec) {
+        std::string names;
+        for (const Codec* registered : registeredCodecs()) {
+            names += (names.empty() ? "" : ", ") + std::string(registered->name());
+        }
+        throw std::invalid_argument("Unknown codec: " + name + " (available: " + names + ").");
+    }
+    return codec->id();
+}
+
+CliOptions parseArguments(int argc, char** argv) {
+    if (argc < 2) {
+        throw std::invalid_argument("Missing command.");
+    }
+
+    CliOptions options;
+    options.command = argv[1];
+    for (int i = 2; i < argc; ++i) {
+        std::string argument = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("Missing value for " + argument + ".");
+            }
+            return argv[++i];
+        };
+
+        if (argument == "-t" || argument == "--threads") {
+            options.threads = std::stoul(value());
+        } else if (argument == "-l" || argument == "--level") {
+            options.level = std::stoi(value());
+        } else if (argument == "--codec") {
+            options.codec = parseCodec(value());
+        } else if (argument == "--filter") {
+            options.filters.push_back(parseFilter(value()));
+            if (options.filters.size() > MAX_FILTERS) {
+                throw std::invalid_argument("At most " + std::to_string(MAX_FILTERS) + " filters can be chained.");
+            }
+        } else if (argument == "--auto-tune") {
+            options.autoTune = true;
+        } else if (argument == "--target-speed") {
+            options.targetSpeed = std::stod(value());
+        } else if (argument == "--base") {
+            options.baseArchive = value();
+        } else if (argument == "--compare-hashes") {
+            options.compareHashes = true;
+        } else if (argument == "--report") {
+            options.reportFile = value();
+        } else if (argument == "-q" || argument == "--quiet") {
+            options.quiet = true;
+        } else if (argument == "--no-resume") {
+            options.resume = false;
+        } else if (argument == "--max-memory") {
+            options.maxMemory = parseSize(value());
+        } else if (argument.size() > 1 && argument[0] == '-') {
+            throw std::invalid_argument("Unknown option: " + argument);
+        } else {
+            options.arguments.push_back(argument);
+        }
+    }
+    return options;
+}
+
+void requireArguments(const CliOptions& options, size_t count) {
+    if (options.arguments.size() != count) {
+        throw std::invalid_argument("Wrong number of arguments for " + options.command + ".");
+    }
+}
+
+const char* entryTypeName(EntryType type) {
+    switch (type) {
+    case EntryType::File:
+    case EntryType::BlockFile:
+        return "file";
+    case EntryType::Directory:
+        return "dir";
+    case EntryType::Link:
+        return "link";
+    }
+    return "?";
+}
+
+void finishJob(const CliOptions& options, const JobStats& stats) {
+    if (!options.reportFile.empty()) {
+        writeJobReport(stats, options.reportFile);
+    }
+    std::printf("%s: %zu files, %llu -> %llu bytes in %.2f s\n", stats.operation.c_str(), stats.files.size(),
+                static_cast<unsigned long long>(stats.bytesIn), static_cast<unsigned long long>(stats.bytesOut),
+                stats.wallSeconds);
+}
+
+// Summary of a stream job, on stderr so that it stays out of the pipeline
+void finishStreamJob(const CliOptions& options, const JobStats& stats) {
+    if (!options.reportFile.empty()) {
+        writeJobReport(stats, options.reportFile);
+    }
+    if (!options.quiet) {
+        std::fprintf(stderr, "%s: %llu -> %llu bytes in %.2f s\n", stats.operation.c_str(),
+                     static_cast<unsigned long long>(stats.bytesIn), static_cast<unsigned long long>(stats.bytesOut),
+                     stats.wallSeconds);
+    }
+}
+
+// Run a stream job between the named files, or stdin and stdout for - or a missing name
+JobStats runStreamJob(const CliOptions& options, bool compress) {
+    if (options.arguments.size() > 2) {
+        throw std::invalid_argument("Wrong number of arguments for " + options.command + ".");
+    }
+    StreamOptions streamOptions;
+    streamOptions.codec = options.codec;
+    streamOptions.filters = options.filters;
+    streamOptions.level = options.level;
+    streamOptions.threads = options.threads;
+    streamOptions.maxMemory = options.maxMemory;
+
+    // The job reads and writes on different threads, so reading stdin mustn't flush stdout
+    std::cin.tie(nullptr);
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    std::ifstream inputFile;
+    std::istream* input = &std::cin;
+    if (options.arguments.size() >= 1 && options.arguments[0] != "-") {
+        inputFile.open(options.arguments[0], std::ios::binary);
+        if (!inputFile) {
+            throw std::runtime_error("Failed to open input file: " + options.arguments[0]);
+        }
+        input = &inputFile;
+    }
+    std::ofstream outputFile;
+    std::ostream* output = &std::cout;
+    if (options.arguments.size() == 2 && options.arguments[1] != "-") {
+        outputFile.open(options.arguments[1], std::ios::binary);
+        if (!outputFile) {
+            throw std::runtime_error("Failed to create output file: " + options.arguments[1]);
+        }
+        output = &outputFile;
+    }
+
+    return compress ? compressStream(*input, *output, streamOptions, &interrupted)
+                    : decompressStream(*input, *output, streamOptions, &interrupted);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    CliOptions options;
+    try {
+        options = parseArguments(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n\n" << USAGE;
+        return 2;
+    }
+
+    std::signal(SIGINT, handleInterrupt);
+
+    // Progress goes to stderr so that list output stays clean
+    int lastPercentage = -1;
+    ProgressCallback progress;
+    if (!options.quiet) {
+        progress = [&lastPercentage](int percentage) {
+            if (percentage != lastPercentage) {
+                lastPercentage = percentage;
+                std::fprintf(stderr, "\r%3d%%", percentage);
+                std::fflush(stderr);
+            }
+        };
+    }
+
+    try {
+        if (options.command == "compress") {
+            requireArguments(options, 2);
+            CompressOptions compressOptions;
+            compressOptions.inputPath = options.arguments[0];
+            compressOptions.outputFile = options.arguments[1];
+            compressOptions.baseArchive = options.baseArchive;
+            compressOptions.compareHashes = options.compareHashes;
+            compressOptions.codec = options.codec;
+            compressOptions.filters = options.filters;
+            compressOptions.level = options.level;
+            compressOptions.autoTune = options.autoTune;
+            compressOptions.targetThroughput = options.targetSpeed * 1024 * 1024;
+            compressOptions.threads = options.threads;
+            compressOptions.resume = options.resume;
+            compressOptions.maxMemory = options.maxMemory;
+
+            JobStats stats = compressArchive(compressOptions, progress, &interrupted);
+            if (lastPercentage >= 0) {
+                std::fprintf(stderr, "\n");
+            }
+            finishJob(options, stats);
+        } else if (options.command == "extract") {
+            requireArguments(options, 2);
+            ExtractOptions extractOptions;
+            extractOptions.inputFile = options.arguments[0];
+            extractOptions.outputPath = options.arguments[1];
+            extractOptions.threads = options.threads;
+            extractOptions.resume = options.resume;
+            extractOptions.maxMemory = options.maxMemory;
+
+            JobStats stats = extractArchive(extractOptions, progress, &interrupted);
+            if (lastPercentage >= 0) {
+                std::fprintf(stderr, "\n");
+            }
+            finishJob(options, stats);
+        } else if (options.command == "list") {
+            requireArguments(options, 1);
+            for (const auto& entry : listArchive(options.arguments[0])) {
+                std::printf("%-4s %12llu %12llu  %s", entryTypeName(entry.type),
+                            static_cast<unsigned long long>(entry.size),
+                            static_cast<unsigned long long>(entry.storedBytes), entry.path.c_str());
+                if (entry.type == EntryType::Link) {
+                    std::printf(" -> %s", entry.linkTarget.c_str());
+                }
+                std::printf("\n");
+            }
+        } else if (options.command == "test") {
+            requireArguments(options, 1);
+            JobStats stats = testArchive(options.arguments[0], progress, &interrupted);
+            if (lastPercentage >= 0) {
+                std::fprintf(stderr, "\n");
+            }
+            finishJob(options, stats);
+            std::printf("No errors found.\n");
+        } else if (options.command == "compress-stream" || options.command == "-c") {
+            finishStreamJob(options, runStreamJob(options, true));
+        } else if (options.command == "decompress-stream" || options.command == "-d") {
+            finishStreamJob(options, runStreamJob(options, false));
+        } else {
+            std::cerr << "Unknown command: " << options.command << "\n\n" << USAGE;
+            return 2;
+        }
+    } catch (const JobCancelled& e) {
+        if (lastPercentage >= 0) {
+            std::fprintf(stderr, "\n");
+        }
+        std::cerr << e.what() << std::endl;
+        return 130;
+    } catch (const std::exception& e) {
+        if (lastPercentage >= 0) {
+            std::fprintf(stderr, "\n");
+        }
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,1493 @@
+#include "ArchiveCompressor.h"
+#include "ArchiveFormat.h"
+#include "BoundedQueue.h"
+#include "FileBackend.h"
+#include "BufferPool.h"
+#include "Checkpoint.h"
+#include "CodecRegistry.h"
+#include "JobProgress.h"
+#include "JobStats.h"
+#include "LZ77Codec.h"
+#include "MemoryBudget.h"
+#include "SimdKernels.h"
+#include "Trace.h"
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <iostream>      // Added this line
+#include <tuple>
+#include <stdexcept>
+#include <algorithm>
+#include <filesystem>
+#include <atomic>
+#include <cmath>
+#include <unordered_map>
+#include <memory>
+#include <array>
+#include <thread>
+#include <future>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+namespace fs = std::filesystem;
+
+// Blocks whose sampled byte entropy (bits per byte) exceeds this are stored raw
+const double INCOMPRESSIBLE_ENTROPY = 7.5;
+
+// Content-defined chunking bounds: a cut point is taken where the top CHUNK_CUT_BITS
+// bits of the rolling hash are zero, so shared regions dedupe even after insertions
+const size_t MIN_CHUNK_SIZE = BLOCK_SIZE / 4;
+const size_t MAX_CHUNK_SIZE = MAX_BLOCK_SIZE;
+const int CHUNK_CUT_BITS = 20;
+
+// Files smaller than this keep the level's settings in auto-tune mode; sampling would cost
+// more than it could save
+const uint64_t AUTO_TUNE_MIN_FILE_SIZE = 256 * 1024;
+
+// Pipeline items queued per compressor thread
+const size_t PIPELINE_QUEUE_DEPTH = 4;
+
+// Small files are read in batches of up to this many files, or the plan's batch bytes
+const size_t IO_BATCH_FILES = 64;
+
+// A file entry of an existing archive, located by its compressed block data
+struct IndexEntry {
+    uint64_t fileSize;
+    int64_t modifiedTime;
+    uint64_t contentHash;
+    LZ77Settings settings;
+    FilterChain filters;
+    std::streamoff blocksOffset;
+    std::streamoff blocksLength;
+};
+
+// Existing archive that unchanged files are copied from in update mode
+struct UpdateSource {
+    std::ifstream archive;
+    uint8_t version = 0;
+    std::unordered_map<std::string, IndexEntry> entries;
+    bool compareHashes = false;
+};
+
+// Earlier file entry with a given content hash, for whole-file deduplication
+struct FileRef {
+    fs::path sourcePath;
+    std::string relativePath;
+};
+
+// Earlier block with a given content hash, for block deduplication
+struct BlockRef {
+    fs::path sourcePath;
+    uint64_t sourceOffset;
+    uint32_t rawSize;
+    size_t blockId;
+};
+
+// Entry found in the partial archive of a resumed job
+struct ResumedEntry {
+    EntryType type;
+    std::string path;
+    uint64_t fileSize = 0;
+    int64_t modifiedTime = 0;
+    uint64_t contentHash = 0;
+    LZ77Settings settings;
+    FilterChain filters;
+    uint64_t numBlocks = 0;
+    uint32_t blocksDone = 0;      // Blocks already in the archive
+};
+
+// What a resumed job finds in its partial archive: the entries the reader skips, in
+// order, and the deduplication state the first run had built up by then
+struct ResumeState {
+    std::vector<ResumedEntry> entries;
+    size_t nextEntry = 0;
+    std::unordered_map<uint64_t, FileRef> files;
+    std::unordered_map<uint64_t, BlockRef> blocks;
+    std::vector<std::streamoff> blockOffsets;
+};
+
+// What the writer does after an item's header bytes
+enum class BlockAction {
+    None,
+    Compress,
+    Duplicate
+};
+
+// Unit of work passed from the reader through the compressors to the writer in archive order
+struct PipelineItem {
+    std::string header;
+    BlockAction action = BlockAction::None;
+    std::shared_ptr<const std::vector<char>> data;
+    size_t blockStart = 0;
+    size_t blockSize = 0;
+    size_t blockId = 0;
+    LZ77Settings settings;
+    BlockCodec codec = BlockCodec::Stored;
+    std::vector<char> payload;
+    uint64_t tokenCount = 0;
+    bool startsEntry = false;
+    std::unique_ptr<FileStats> fileStats;  // Set on the first item of a file entry
+    size_t reservedBytes = 0;
+    uint64_t progressBytes = 0;
+    bool resumePoint = true;      // The archive can be resumed right after this item
+    uint32_t entryBlocks = 0;     // Blocks of its entry in the archive once this item is written
+    std::promise<void> compressed;
+};
+
+// Bytes read but not yet written; the reader waits here once the limit is reached
+class InFlightBytes {
+public:
+    explicit InFlightBytes(size_t limit) : m_limit(limit), m_used(0), m_closed(false) {}
+
+    // A single reservation larger than the limit is let through once nothing else is in flight
+    bool acquire(size_t bytes) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_released.wait(lock, [&]() { return m_closed || m_used == 0 || m_used + bytes <= m_limit; });
+        m_used += bytes;
+        return !m_closed;
+    }
+
+    void release(size_t bytes) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_used -= std::min(bytes, m_used);
+        m_released.notify_all();
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_released.notify_all();
+    }
+
+private:
+    size_t m_limit;
+    size_t m_used;
+    bool m_closed;
+    std::mutex m_mutex;
+    std::condition_variable m_released;
+};
+
+// State shared by all entries of a compression job. The reader (the calling thread)
+// walks the input and makes every layout decision, compressor threads turn blocks
+// into payloads, and a single writer thread appends items to the archive in order.
+struct CompressionContext {
+    explicit CompressionContext(const CompressionPlan& plan)
+        : plan(plan),
+          buffers(BufferPool::DEFAULT_RETAINED_BUFFERS, plan.retainedBytes),
+          compressQueue(plan.threads * PIPELINE_QUEUE_DEPTH),
+          writeQueue(plan.threads * PIPELINE_QUEUE_DEPTH * 2),
+          inFlight(plan.inFlightBytes) {}
+
+    CompressionPlan plan;
+    fs::path basePath;
+    fs::path outputFile;
+    std::ofstream outfile;
+    std::unique_ptr<FileBackend> io;
+    BufferPool buffers;
+    std::unique_ptr<ProgressReporter> progress;
+    const CancellationToken* cancel = nullptr;
+    const Codec* codec = nullptr;
+    FilterChain filters;
+    LZ77Settings settings;
+    bool autoTune = false;
+    double targetThroughput = 0;
+    std::unique_ptr<UpdateSource> update;
+
+    // Checkpoints, written by the writer; checkpointFile is empty when they are off
+    fs::path checkpointFile;
+    uint64_t jobHash = 0;
+    std::unique_ptr<ResumeState> resume;
+    bool inputChanged = false;
+
+    // Reader state
+    std::unordered_map<uint64_t, FileRef> files;
+    std::unordered_map<uint64_t, BlockRef> blocks;
+    size_t nextBlockId = 0;
+
+    // Pipeline stages
+    BoundedQueue<std::shared_ptr<PipelineItem>> compressQueue;
+    BoundedQueue<std::shared_ptr<PipelineItem>> writeQueue;
+    InFlightBytes inFlight;
+    std::exception_ptr firstError;
+    std::mutex errorMutex;
+
+    // Statistics; files and sizes are kept by the writer, the rest is merged in by each thread
+    JobStats stats;
+    std::mutex statsMutex;
+    uint64_t readNanoseconds = 0;
+
+    // Writer state
+    std::vector<std::streamoff> blockOffsets;
+    uint64_t entriesWritten = 0;
+    Checkpoint resumePoint;
+    Checkpoint lastCheckpoint;
+    std::chrono::steady_clock::time_point lastCheckpointTime;
+};
+
+// A regular file found by the reader, waiting to be read as part of a batch
+struct PendingFile {
+    fs::path path;
+    std::string relativePath;
+    uint64_t fileSize = 0;
+    int64_t modifiedTime = 0;
+    const IndexEntry* unchanged = nullptr;
+    bool needsRead = true;
+    std::shared_ptr<std::vector<char>> data;
+    uint64_t contentHash = 0;
+    const ResumedEntry* resumed = nullptr;
+
+    // Files above the plan's stream size are scanned for their hash and block boundaries,
+    // then read again one block at a time instead of whole
+    bool streamed = false;
+    std::vector<size_t> boundaries;
+};
+
+// Function prototypes
+void compressPath(const fs::path& path, CompressionContext& context);
+PendingFile inspectFile(const fs::path& filePath, CompressionContext& context);
+void compressFiles(std::vector<PendingFile>& batch, CompressionContext& context);
+void compressFile(PendingFile& file, CompressionContext& context);
+void scanFile(PendingFile& file, CompressionContext& context);
+std::shared_ptr<std::vector<char>> readBlock(std::ifstream& infile, const PendingFile& file, size_t blockSize,
+                                             CompressionContext& context);
+void submitBlocks(const PendingFile& file, const std::vector<size_t>& boundaries, size_t firstBlock,
+                  const LZ77Settings& settings, CompressionContext& context);
+LZ77Settings tuneFile(const PendingFile& file, CompressionContext& context);
+void submitItem(CompressionContext& context, std::shared_ptr<PipelineItem> item);
+void compressorStage(CompressionContext& context);
+void writerStage(CompressionContext& context);
+void compressBlock(PipelineItem& item, const Codec& codec, const FilterChain& filters, CodecWorkspace& workspace,
+                   BufferPool& buffers);
+void failPipeline(CompressionContext& context);
+uint64_t jobFingerprint(const CompressOptions& options);
+bool loadResumeState(CompressionContext& context);
+void readResumedEntries(const fs::path& archivePath, uint64_t endOffset, const fs::path& basePath,
+                        const UpdateSource* update, ResumeState& resume);
+const ResumedEntry* nextResumedEntry(CompressionContext& context, const std::string& relativePath, bool directory);
+void inputChanged(CompressionContext& context);
+void saveCheckpoint(CompressionContext& context);
+std::string entryHeader(EntryType entryType, const std::string& relativePath);
+std::vector<size_t> findChunkBoundaries(const char* data, size_t size);
+size_t chunkLength(const char* data, size_t remaining);
+bool sameContent(const fs::path& sourcePath, uint64_t sourceOffset, const char* data, size_t size);
+bool sameFileContent(const fs::path& sourcePath, const fs::path& filePath, uint64_t size);
+std::shared_ptr<std::vector<char>> pooledBuffer(std::vector<char> data, BufferPool& buffers);
+void readArchiveIndex(const fs::path& archivePath, UpdateSource& update);
+int64_t modifiedTime(const fs::path& filePath);
+std::string relativeEntryPath(const fs::path& path, const fs::path& basePath);
+
+JobStats compressArchive(const CompressOptions& options, const ProgressCallback& progress,
+                         const CancellationToken* cancel) {
+    JobClock clock;
+
+    if (options.level < MIN_COMPRESSION_LEVEL || options.level > MAX_COMPRESSION_LEVEL) {
+        throw std::runtime_error("Invalid compression level.");
+    }
+    const Codec* codec = findCodec(options.codec);
+    if (!codec) {
+        throw std::runtime_error("Unknown codec.");
+    }
+    if (!validFilterChain(options.filters)) {
+        throw std::runtime_error("Invalid filter chain.");
+    }
+
+    // Calculate total bytes for progress tracking
+    size_t totalBytes = 0;
+    // Entry paths are taken relative to the input's parent, which a relative path may not have
+    fs::path inputPath = fs::absolute(options.inputPath);
+
+    if (fs::is_directory(inputPath)) {
+        for (const auto& entry : fs::recursive_directory_iterator(inputPath)) {
+            if (fs::is_regular_file(entry.path())) {
+                totalBytes += fs::file_size(entry.path());
+            }
+        }
+    } else if (fs::is_regular_file(inputPath)) {
+        totalBytes = fs::file_size(inputPath);
+    } else {
+        throw std::runtime_error("Invalid input path.");
+    }
+
+    // Filtering takes a filtered copy of the block and, for records, a second one
+    size_t scratchBytes = codec->encodeWorkspaceBytes(MAX_BLOCK_SIZE) + (options.filters.empty() ? 0 : 2 * MAX_BLOCK_SIZE);
+    CompressionContext context(planCompression(options.maxMemory, options.threads, scratchBytes));
+    context.progress = std::make_unique<ProgressReporter>(progress, totalBytes);
+    context.cancel = cancel;
+    context.codec = codec;
+    context.filters = options.filters;
+    context.settings = settingsForLevel(options.level);
+    context.autoTune = options.autoTune;
+    context.targetThroughput = options.targetThroughput;
+    context.io = createFileBackend();
+    context.stats.operation = "compress";
+    context.stats.ioBackend = context.io->name();
+    context.stats.simdLevel = simdLevelName(simdKernels().level);
+
+    // In update mode, index the previous archive before the output is created
+    if (!options.baseArchive.empty()) {
+        fs::path baseArchive = options.baseArchive;
+        std::error_code ec;
+        if (fs::equivalent(baseArchive, options.outputFile, ec)) {
+            throw std::runtime_error("The updated archive must be written to a new file.");
+        }
+
+        context.update = std::make_unique<UpdateSource>();
+        context.update->compareHashes = options.compareHashes;
+        readArchiveIndex(baseArchive, *context.update);
+    }
+
+    // Define basePath for relative path calculations
+    if (fs::is_directory(inputPath)) {
+        context.basePath = inputPath.parent_path();
+    } else if (fs::is_regular_file(inputPath)) {
+        context.basePath = inputPath.parent_path();
+    }
+
+    context.outputFile = options.outputFile;
+    context.lastCheckpoint.prefixHash = FNV_OFFSET_BASIS;
+    context.lastCheckpointTime = std::chrono::steady_clock::now();
+    if (options.resume) {
+        context.checkpointFile = checkpointPath(context.outputFile);
+        context.jobHash = jobFingerprint(options);
+    } else {
+        removeCheckpoint(checkpointPath(context.outputFile));
+    }
+
+    if (options.resume && loadResumeState(context)) {
+        // Continue after the last checkpoint, dropping whatever was written past it
+        fs::resize_file(context.outputFile, context.lastCheckpoint.offset);
+        context.outfile.open(options.outputFile, std::ios::binary | std::ios::in | std::ios::out);
+        context.outfile.seekp(0, std::ios::end);
+        if (!context.outfile) {
+            throw std::runtime_error("Failed to open output file.");
+        }
+        context.stats.resumedEntries = context.lastCheckpoint.entries;
+    } else {
+        context.outfile.open(options.outputFile, std::ios::binary);
+        if (!context.outfile) {
+            throw std::runtime_error("Failed to create output file.");
+        }
+
+        writeArchiveHeader(context.outfile);
+    }
+
+    // Start the compressor and writer stages, then read on this thread
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < context.plan.threads; ++i) {
+        threads.emplace_back(compressorStage, std::ref(context));
+    }
+    threads.emplace_back(writerStage, std::ref(context));
+
+    try {
+        compressPath(inputPath, context);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(context.errorMutex);
+        if (!context.firstError) {
+            context.firstError = std::current_exception();
+        }
+    }
+    if (context.firstError) {
+        failPipeline(context);
+    }
+
+    context.compressQueue.close();
+    context.writeQueue.close();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (context.firstError) {
+        // Keep the partial archive if a later run can resume it; otherwise it is of no use
+        context.outfile.close();
+        bool resumable = false;
+        if (!context.checkpointFile.empty() && !context.inputChanged) {
+            try {
+                saveCheckpoint(context);
+                resumable = context.lastCheckpoint.offset != 0;
+            } catch (const std::exception&) {
+                resumable = false;
+            }
+        }
+        if (!resumable) {
+            std::error_code ec;
+            fs::remove(options.outputFile, ec);
+            removeCheckpoint(checkpointPath(context.outputFile));
+        }
+        std::rethrow_exception(context.firstError);
+    }
+
+    context.stats.bytesOut = static_cast<uint64_t>(context.outfile.tellp());
+    context.outfile.close();
+    if (!context.outfile) {
+        throw std::runtime_error("Failed to write output file.");
+    }
+    removeCheckpoint(checkpointPath(context.outputFile));
+
+    JobStats& stats = context.stats;
+    stats.stages.ioNanoseconds += context.readNanoseconds;
+    stats.buffers = context.buffers.stats();
+    for (const auto& file : stats.files) {
+        stats.bytesIn += file.bytesIn;
+    }
+    clock.stop(stats);
+
+    return std::move(context.stats);
+}
+
+void compressPath(const fs::path& path, CompressionContext& context) {
+    if (fs::is_directory(path)) {
+        // Queue directory entry, unless a resumed archive already has it
+        std::string relativePath = relativeEntryPath(path, context.basePath);
+        if (!nextResumedEntry(context, relativePath, true)) {
+            auto item = std::make_shared<PipelineItem>();
+            item->header = entryHeader(EntryType::Directory, relativePath);
+            item->startsEntry = true;
+            submitItem(context, item);
+        }
+
+        // Recurse into directory, reading runs of files together
+        std::vector<PendingFile> batch;
+        size_t batchBytes = 0;
+        for (const auto& entry : fs::directory_iterator(path)) {
+            if (!entry.is_regular_file()) {
+                compressFiles(batch, context);
+                batchBytes = 0;
+                compressPath(entry.path(), context);
+                continue;
+            }
+
+            batch.push_back(inspectFile(entry.path(), context));
+            batchBytes += batch.back().needsRead ? batch.back().fileSize : 0;
+            if (batch.size() >= IO_BATCH_FILES || batchBytes >= context.plan.batchBytes) {
+                compressFiles(batch, context);
+                batchBytes = 0;
+            }
+        }
+        compressFiles(batch, context);
+    } else if (fs::is_regular_file(path)) {
+        std::vector<PendingFile> batch;
+        batch.push_back(inspectFile(path, context));
+        compressFiles(batch, context);
+    }
+}
+
+// Gather what is known about a file before reading it
+PendingFile inspectFile(const fs::path& filePath, CompressionContext& context) {
+    PendingFile file;
+    file.path = filePath;
+    file.relativePath = relativeEntryPath(filePath, context.basePath);
+    file.fileSize = fs::file_size(filePath);
+    file.modifiedTime = modifiedTime(filePath);
+
+    // A resumed archive's complete entries are skipped without reading the file
+    file.resumed = nextResumedEntry(context, file.relativePath, false);
+    if (file.resumed) {
+        if (file.resumed->fileSize != file.fileSize || file.resumed->modifiedTime != file.modifiedTime) {
+            inputChanged(context);
+        }
+        file.needsRead = file.resumed->blocksDone < file.resumed->numBlocks;
+        return file;
+    }
+
+    // Look for an unchanged copy of this file in the base archive
+    UpdateSource* update = context.update.get();
+    if (update) {
+        auto it = update->entries.find(file.relativePath);
+        if (it != update->entries.end() &&
+            it->second.fileSize == file.fileSize && it->second.modifiedTime == file.modifiedTime) {
+            file.unchanged = &it->second;
+        }
+    }
+
+    // Unchanged entries are copied without looking at the file
+    file.needsRead = !file.unchanged || update->compareHashes;
+    return file;
+}
+
+// Read a batch of files through the I/O backend, then queue each one in order.
+// Read-ahead is reserved up front and released by the writer as blocks are written.
+void compressFiles(std::vector<PendingFile>& batch, CompressionContext& context) {
+    if (batch.empty()) {
+        return;
+    }
+
+    std::vector<FileRequest> requests;
+    size_t reserved = 0;
+    for (auto& file : batch) {
+        file.streamed = file.needsRead && file.fileSize > context.plan.streamFileSize;
+        if (file.needsRead && !file.streamed) {
+            FileRequest request;
+            request.path = file.path;
+            request.expectedSize = file.fileSize;
+            request.data = context.buffers.acquire(file.fileSize + 1);
+            requests.push_back(std::move(request));
+            reserved += file.fileSize;
+        }
+    }
+
+    if (!requests.empty()) {
+        if (!context.inFlight.acquire(reserved)) {
+            throw std::runtime_error("Compression pipeline stopped.");
+        }
+        try {
+            StageTimer timer(context.readNanoseconds);
+            context.io->readFiles(requests);
+        } catch (...) {
+            context.inFlight.release(reserved);
+            throw;
+        }
+    }
+
+    size_t next = 0;
+    for (auto& file : batch) {
+        if (file.streamed) {
+            file.data = std::make_shared<std::vector<char>>();
+            scanFile(file, context);
+        } else if (file.needsRead) {
+            std::vector<char>& data = requests[next++].data;
+
+            // The file may have changed size since it was measured
+            if (data.size() > file.fileSize) {
+                if (!context.inFlight.acquire(data.size() - file.fileSize)) {
+                    throw std::runtime_error("Compression pipeline stopped.");
+                }
+            } else {
+                context.inFlight.release(file.fileSize - data.size());
+            }
+
+            file.fileSize = data.size();
+            file.contentHash = hashData(data.data(), data.size());
+            file.data = pooledBuffer(std::move(data), context.buffers);
+        } else {
+            file.data = std::make_shared<std::vector<char>>();
+        }
+
+        if (file.needsRead) {
+            if (file.unchanged && (file.unchanged->fileSize != file.fileSize ||
+                                   file.unchanged->contentHash != file.contentHash)) {
+                file.unchanged = nullptr;
+            }
+        }
+
+        compressFile(file, context);
+    }
+
+    batch.clear();
+}
+
+void compressFile(PendingFile& file, CompressionContext& context) {
+    UpdateSource* update = context.update.get();
+
+    const fs::path& filePath = file.path;
+    const std::string& relativePath = file.relativePath;
+    const IndexEntry* unchanged = file.unchanged;
+    std::shared_ptr<std::vector<char>> data = file.data;
+    uint64_t fileSize = file.fileSize;
+    int64_t fileTime = file.modifiedTime;
+    uint64_t contentHash = file.contentHash;
+
+    // Entries of a resumed archive: complete ones are done, a partial one continues with its next block
+    if (file.resumed) {
+        const ResumedEntry& resumed = *file.resumed;
+        if (resumed.blocksDone == resumed.numBlocks) {
+            context.progress->add(fileSize);
+            return;
+        }
+
+        std::vector<size_t> boundaries = file.streamed ? file.boundaries : findChunkBoundaries(data->data(), data->size());
+        if (contentHash != resumed.contentHash || boundaries.size() != resumed.numBlocks) {
+            inputChanged(context);
+        }
+        size_t doneBytes = resumed.blocksDone == 0 ? 0 : boundaries[resumed.blocksDone - 1];
+        if (!file.streamed) {
+            context.inFlight.release(doneBytes);
+        }
+        context.progress->add(doneBytes);
+        submitBlocks(file, boundaries, resumed.blocksDone, resumed.settings, context);
+        return;
+    }
+
+    if (unchanged) {
+        context.inFlight.release(data->size());
+
+        std::ostringstream header;
+        header << entryHeader(EntryType::BlockFile, relativePath);
+        writeUInt64(header, fileSize);
+        writeUInt64(header, static_cast<uint64_t>(fileTime));
+        writeUInt64(header, unchanged->contentHash);
+        writeVarUInt(header, unchanged->settings.windowSize);
+        writeVarUInt(header, unchanged->settings.maxMatchLength);
+        writeFilterChain(header, unchanged->filters);
+
+        // Copy the compressed blocks verbatim, in pieces so memory stays bounded
+        const std::streamoff COPY_CHUNK = 1024 * 1024;
+        update->archive.seekg(unchanged->blocksOffset);
+        uint64_t numBlocks = readVarUInt(update->archive);
+        update->archive.seekg(unchanged->blocksOffset);
+        std::streamoff remaining = unchanged->blocksLength;
+        do {
+            auto item = std::make_shared<PipelineItem>();
+            item->header = header.str();
+            if (remaining == unchanged->blocksLength) {
+                item->startsEntry = true;
+                item->fileStats.reset(new FileStats{ relativePath, fileSize, 0, 0, unchanged->settings.windowSize,
+                                                     unchanged->settings.maxMatchLength,
+                                                     filterChainName(unchanged->filters) });
+            }
+            header.str(std::string());
+
+            size_t chunk = static_cast<size_t>(std::min(remaining, COPY_CHUNK));
+            size_t headerSize = item->header.size();
+            item->header.resize(headerSize + chunk);
+            update->archive.read(&item->header[headerSize], chunk);
+            if (!update->archive) {
+                throw std::runtime_error("Failed to read entry from base archive: " + relativePath);
+            }
+            remaining -= chunk;
+
+            if (remaining == 0) {
+                item->progressBytes = fileSize;
+                item->entryBlocks = static_cast<uint32_t>(numBlocks);
+            } else {
+                item->resumePoint = false;
+            }
+            if (!context.inFlight.acquire(item->header.size())) {
+                throw std::runtime_error("Compression pipeline stopped.");
+            }
+            item->reservedBytes = item->header.size();
+            submitItem(context, item);
+        } while (remaining > 0);
+
+        context.files.emplace(unchanged->contentHash, FileRef{ filePath, relativePath });
+        return;
+    }
+
+    // Identical files are stored once and linked from later entries
+    if (fileSize > 0) {
+        auto it = context.files.find(contentHash);
+        if (it != context.files.end() && fs::file_size(it->second.sourcePath) == fileSize &&
+            (file.streamed ? sameFileContent(it->second.sourcePath, filePath, fileSize)
+                           : sameContent(it->second.sourcePath, 0, data->data(), data->size()))) {
+            context.inFlight.release(data->size());
+
+            std::ostringstream header;
+            header << entryHeader(EntryType::Link, relativePath);
+            writeUInt64(header, fileSize);
+            writeUInt64(header, static_cast<uint64_t>(fileTime));
+            writeUInt64(header, contentHash);
+
+            // Write link target path length and data
+            const std::string& targetPath = it->second.relativePath;
+            writeVarUInt(header, targetPath.length());
+            header.write(targetPath.c_str(), targetPath.length());
+
+            auto item = std::make_shared<PipelineItem>();
+            item->header = header.str();
+            item->startsEntry = true;
+            item->fileStats.reset(new FileStats{ relativePath, fileSize, 0, 0, 0, 0, std::string() });
+            item->progressBytes = fileSize;
+            submitItem(context, item);
+            return;
+        }
+        context.files.emplace(contentHash, FileRef{ filePath, relativePath });
+    }
+
+    LZ77Settings settings = context.settings;
+    if (context.autoTune && fileSize >= AUTO_TUNE_MIN_FILE_SIZE) {
+        settings = tuneFile(file, context);
+    }
+
+    // Queue file entry with metadata used by later updates, followed by its blocks
+    std::ostringstream header;
+    header << entryHeader(EntryType::BlockFile, relativePath);
+    writeUInt64(header, fileSize);
+    writeUInt64(header, static_cast<uint64_t>(fileTime));
+    writeUInt64(header, contentHash);
+    writeVarUInt(header, settings.windowSize);
+    writeVarUInt(header, settings.maxMatchLength);
+    writeFilterChain(header, context.filters);
+
+    std::vector<size_t> boundaries = file.streamed ? file.boundaries : findChunkBoundaries(data->data(), data->size());
+    writeVarUInt(header, boundaries.size());
+
+    auto item = std::make_shared<PipelineItem>();
+    item->header = header.str();
+    item->startsEntry = true;
+    item->fileStats.reset(new FileStats{ relativePath, fileSize, 0, 0, settings.windowSize, settings.maxMatchLength,
+                                         filterChainName(context.filters) });
+    if (boundaries.empty()) {
+        item->progressBytes = fileSize;
+    }
+    submitItem(context, item);
+
+    submitBlocks(file, boundaries, 0, settings, context);
+}
+
+// Tune the match finder on a sample from the middle of a file, read back from disk if the file is streamed
+LZ77Settings tuneFile(const PendingFile& file, CompressionContext& context) {
+    size_t sampleSize = static_cast<size_t>(std::min<uint64_t>(file.fileSize, TUNING_SAMPLE_SIZE));
+    uint64_t sampleOffset = (file.fileSize - sampleSize) / 2;
+
+    std::vector<char> streamedSample;
+    const char* sample = file.data->data() + sampleOffset;
+    if (file.streamed) {
+        streamedSample.resize(sampleSize);
+        std::ifstream infile(file.path, std::ios::binary);
+        infile.seekg(static_cast<std::streamoff>(sampleOffset));
+        infile.read(streamedSample.data(), sampleSize);
+        if (!infile) {
+            throw std::runtime_error("File changed while being archived: " + file.path.string());
+        }
+        sample = streamedSample.data();
+    }
+
+    uint64_t nanoseconds = 0;
+    LZ77Settings settings;
+    {
+        StageTimer timer(nanoseconds);
+        settings = tuneSettings(sample, sampleSize, context.targetThroughput);
+    }
+
+    std::lock_guard<std::mutex> lock(context.statsMutex);
+    context.stats.stages.tuningNanoseconds += nanoseconds;
+    return settings;
+}
+
+// Queue a file's blocks from firstBlock on, each either compressed or referencing an identical earlier block
+void submitBlocks(const PendingFile& file, const std::vector<size_t>& boundaries, size_t firstBlock,
+                  const LZ77Settings& settings, CompressionContext& context) {
+    const fs::path& filePath = file.path;
+
+    // Streamed files are read again block by block, checking they still hash the same
+    std::ifstream infile;
+    uint64_t streamHash = FNV_OFFSET_BASIS;
+    size_t blockStart = firstBlock == 0 ? 0 : boundaries[firstBlock - 1];
+    if (file.streamed) {
+        infile.open(filePath, std::ios::binary);
+        infile.seekg(static_cast<std::streamoff>(blockStart));
+    }
+
+    for (size_t index = firstBlock; index < boundaries.size(); ++index) {
+        size_t blockEnd = boundaries[index];
+        size_t blockSize = blockEnd - blockStart;
+
+        auto block = std::make_shared<PipelineItem>();
+        if (file.streamed) {
+            block->data = readBlock(infile, file, blockSize, context);
+            streamHash = hashData(block->data->data(), blockSize, streamHash);
+        } else {
+            block->data = file.data;
+            block->blockStart = blockStart;
+        }
+        const char* blockData = block->data->data() + block->blockStart;
+        block->blockSize = blockSize;
+        block->settings = settings;
+        block->reservedBytes = blockSize;
+        block->progressBytes = blockSize;
+        block->entryBlocks = static_cast<uint32_t>(index + 1);
+
+        // Reference an identical block queued earlier in the archive
+        uint64_t blockHash = hashData(blockData, blockSize);
+        auto it = context.blocks.find(blockHash);
+        if (it != context.blocks.end() && it->second.rawSize == blockSize) {
+            const BlockRef& ref = it->second;
+            bool duplicate = ref.sourcePath == filePath && !file.streamed
+                ? std::equal(blockData, blockData + blockSize, file.data->data() + ref.sourceOffset)
+                : sameContent(ref.sourcePath, ref.sourceOffset, blockData, blockSize);
+            if (duplicate) {
+                block->action = BlockAction::Duplicate;
+                block->blockId = ref.blockId;
+            }
+        }
+
+        if (block->action != BlockAction::Duplicate) {
+            block->action = BlockAction::Compress;
+            block->blockId = context.nextBlockId++;
+            if (it == context.blocks.end()) {
+                context.blocks.emplace(blockHash, BlockRef{ filePath, blockStart, static_cast<uint32_t>(blockSize), block->blockId });
+            }
+        }
+
+        submitItem(context, block);
+        blockStart = blockEnd;
+    }
+
+    if (file.streamed && firstBlock == 0 && streamHash != file.contentHash) {
+        throw std::runtime_error("File changed while being archived: " + filePath.string());
+    }
+}
+
+// First pass over a streamed file: hash it and find its block boundaries while holding
+// no more than two blocks of it, the same boundaries findChunkBoundaries gives for the whole file
+void scanFile(PendingFile& file, CompressionContext& context) {
+    std::ifstream infile(file.path, std::ios::binary);
+    if (!infile) {
+        throw std::runtime_error("Failed to open input file: " + file.path.string());
+    }
+
+    std::vector<char> buffer = context.buffers.acquire(2 * MAX_CHUNK_SIZE);
+    buffer.resize(2 * MAX_CHUNK_SIZE);
+    size_t bufferStart = 0;   // Start of the current chunk in buffer
+    size_t bufferEnd = 0;
+    size_t chunkStart = 0;    // Start of the current chunk in the file
+    uint64_t fileRead = 0;
+    file.contentHash = FNV_OFFSET_BASIS;
+    file.boundaries.clear();
+
+    while (chunkStart < file.fileSize) {
+        // Keep a whole chunk's worth of the file ahead of the cut point search
+        size_t remaining = file.fileSize - chunkStart;
+        if (bufferEnd - bufferStart < std::min(remaining, MAX_CHUNK_SIZE)) {
+            std::copy(buffer.begin() + bufferStart, buffer.begin() + bufferEnd, buffer.begin());
+            bufferEnd -= bufferStart;
+            bufferStart = 0;
+
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(buffer.size() - bufferEnd, file.fileSize - fileRead));
+            {
+                StageTimer timer(context.readNanoseconds);
+                infile.read(buffer.data() + bufferEnd, chunk);
+            }
+            if (!infile) {
+                throw std::runtime_error("File changed while being archived: " + file.path.string());
+            }
+            file.contentHash = hashData(buffer.data() + bufferEnd, chunk, file.contentHash);
+            bufferEnd += chunk;
+            fileRead += chunk;
+        }
+
+        size_t length = chunkLength(buffer.data() + bufferStart, remaining);
+        bufferStart += length;
+        chunkStart += length;
+        file.boundaries.push_back(chunkStart);
+    }
+
+    context.buffers.release(std::move(buffer));
+}
+
+// Read the next block of a streamed file into a pooled buffer, once its read-ahead is reserved
+std::shared_ptr<std::vector<char>> readBlock(std::ifstream& infile, const PendingFile& file, size_t blockSize,
+                                             CompressionContext& context) {
+    if (!context.inFlight.acquire(blockSize)) {
+        throw std::runtime_error("Compression pipeline stopped.");
+    }
+
+    std::vector<char> data = context.buffers.acquire(blockSize);
+    data.resize(blockSize);
+    {
+        StageTimer timer(context.readNanoseconds);
+        infile.read(data.data(), blockSize);
+    }
+    if (!infile) {
+        context.inFlight.release(blockSize);
+        throw std::runtime_error("File changed while being archived: " + file.path.string());
+    }
+    return pooledBuffer(std::move(data), context.buffers);
+}
+
+// Hand an item to the writer, and to the compressors if it carries a block to compress
+void submitItem(CompressionContext& context, std::shared_ptr<PipelineItem> item) {
+    throwIfCancelled(context.cancel);
+
+    if (item->action != BlockAction::Compress) {
+        item->compressed.set_value();
+    } else if (!context.compressQueue.push(item)) {
+        throw std::runtime_error("Compression pipeline stopped.");
+    }
+
+    if (!context.writeQueue.push(std::move(item))) {
+        throw std::runtime_error("Compression pipeline stopped.");
+    }
+}
+
+void compressorStage(CompressionContext& context) {
+    // Scratch space reused for every block this thread compresses
+    CodecWorkspace workspace;
+    workspace.cancel = context.cancel;
+
+    std::shared_ptr<PipelineItem> item;
+    while (context.compressQueue.pop(item)) {
+        try {
+            compressBlock(*item, *context.codec, context.filters, workspace, context.buffers);
+            item->compressed.set_value();
+        } catch (...) {
+            item->compressed.set_exception(std::current_exception());
+        }
+        item.reset();
+    }
+
+    std::lock_guard<std::mutex> lock(context.statsMutex);
+    context.stats.tokens.merge(workspace.tokenStats);
+    context.stats.stages.merge(workspace.times);
+}
+
+// Compress block independently of its neighbours, unless a sample says it won't shrink.
+// The codec sees the block through the entry's filters; stored blocks stay unfiltered.
+void compressBlock(PipelineItem& item, const Codec& codec, const FilterChain& filters, CodecWorkspace& workspace,
+                   BufferPool& buffers) {
+    const char* blockData = item.data->data() + item.blockStart;
+    size_t blockSize = item.blockSize;
+
+    item.codec = BlockCodec::Stored;
+    if (!isLikelyIncompressible(blockData, blockSize)) {
+        const char* input = blockData;
+        if (!filters.empty()) {
+            StageTimer timer(workspace.times.filteringNanoseconds);
+            applyFilters(filters, blockData, blockSize, workspace.filtered, workspace.filterScratch);
+            input = workspace.filtered.data();
+        }
+
+        // Encode into a pooled buffer the writer hands back
+        item.payload = buffers.acquire(codec.bound(blockSize));
+        workspace.tokenCount = 0;
+        if (codec.compress(input, blockSize, item.settings, workspace, item.payload)) {
+            item.codec = codec.id();
+            item.tokenCount = workspace.tokenCount;
+        } else {
+            buffers.release(std::move(item.payload));
+            item.payload.clear();
+        }
+    }
+
+    LZ77_TRACE(LZ77_TRACE_BLOCK, "Block at " << item.blockStart << " - Raw: " << blockSize
+                                 << ", Codec: " << findCodec(item.codec)->name()
+                                 << ", Payload: " << (item.codec == BlockCodec::Stored ? blockSize : item.payload.size()));
+}
+
+void writerStage(CompressionContext& context) {
+    std::ofstream& outfile = context.outfile;
+    StageTimes times;
+    FileStats* currentFile = nullptr;
+
+    std::shared_ptr<PipelineItem> item;
+    while (context.writeQueue.pop(item)) {
+        try {
+            item->compressed.get_future().get();
+            throwIfCancelled(context.cancel);
+            StageTimer timer(times.ioNanoseconds);
+
+            // Attribute everything up to the next entry to this one
+            if (item->startsEntry) {
+                ++context.entriesWritten;
+                currentFile = nullptr;
+                if (item->fileStats) {
+                    context.stats.files.push_back(std::move(*item->fileStats));
+                    currentFile = &context.stats.files.back();
+                }
+            }
+            if (currentFile) {
+                currentFile->bytesOut += item->header.size();
+                currentFile->tokens += item->tokenCount;
+                if (item->action != BlockAction::None) {
+                    // Codec, raw size and payload size, then the payload
+                    size_t payloadSize = item->action == BlockAction::Duplicate ? sizeof(uint64_t)
+                                       : item->codec == BlockCodec::Stored ? item->blockSize
+                                       : item->payload.size();
+                    currentFile->bytesOut += 1 + varUIntSize(item->blockSize) + varUIntSize(payloadSize) + payloadSize;
+                }
+            }
+
+            outfile.write(item->header.data(), item->header.size());
+
+            if (item->action != BlockAction::None) {
+                BlockCodec codec = item->action == BlockAction::Duplicate ? BlockCodec::Duplicate : item->codec;
+                if (item->action == BlockAction::Compress) {
+                    if (context.blockOffsets.size() <= item->blockId) {
+                        context.blockOffsets.resize(item->blockId + 1);
+                    }
+                    context.blockOffsets[item->blockId] = outfile.tellp();
+                }
+
+                // Write block header: codec, raw size and payload size in bytes
+                outfile.write(reinterpret_cast<char*>(&codec), sizeof(codec));
+                writeVarUInt(outfile, item->blockSize);
+
+                if (codec == BlockCodec::Duplicate) {
+                    writeVarUInt(outfile, sizeof(uint64_t));
+                    writeUInt64(outfile, static_cast<uint64_t>(context.blockOffsets.at(item->blockId)));
+                } else if (codec == BlockCodec::Stored) {
+                    writeVarUInt(outfile, item->blockSize);
+                    outfile.write(item->data->data() + item->blockStart, item->blockSize);
+                } else {
+                    writeVarUInt(outfile, item->payload.size());
+                    outfile.write(item->payload.data(), item->payload.size());
+                    context.buffers.release(std::move(item->payload));
+                }
+            }
+
+            if (!outfile) {
+                throw std::runtime_error("Failed to write output file.");
+            }
+            context.inFlight.release(item->reservedBytes);
+            context.progress->add(item->progressBytes);
+
+            if (item->resumePoint) {
+                context.resumePoint.offset = static_cast<uint64_t>(outfile.tellp());
+                context.resumePoint.entries = context.entriesWritten;
+                context.resumePoint.blocks = item->entryBlocks;
+            }
+            if (!context.checkpointFile.empty() &&
+                std::chrono::steady_clock::now() - context.lastCheckpointTime >= CHECKPOINT_INTERVAL) {
+                saveCheckpoint(context);
+            }
+        } catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(context.errorMutex);
+                if (!context.firstError) {
+                    context.firstError = std::current_exception();
+                }
+            }
+            failPipeline(context);
+            break;
+        }
+        item.reset();
+    }
+
+    std::lock_guard<std::mutex> lock(context.statsMutex);
+    context.stats.stages.merge(times);
+}
+
+// Stop every stage after an error; blocked producers wake up and bail out
+void failPipeline(CompressionContext& context) {
+    context.compressQueue.close();
+    context.writeQueue.close();
+    context.inFlight.close();
+}
+
+// Fingerprint of everything that decides an archive's layout, so that a checkpoint
+// is only ever resumed by the same job
+uint64_t jobFingerprint(const CompressOptions& options) {
+    std::ostringstream job;
+    job << fs::absolute(options.inputPath).lexically_normal().string() << '\n'
+        << (options.baseArchive.empty() ? std::string() : fs::absolute(options.baseArchive).lexically_normal().string())
+        << '\n' << options.compareHashes << '\n' << options.level << '\n' << options.autoTune << '\n'
+        << options.targetThroughput << '\n' << static_cast<int>(options.codec) << '\n'
+        << filterChainName(options.filters);
+    std::string text = job.str();
+    return hashData(text.data(), text.size());
+}
+
+// Take over the partial archive of an interrupted run if its checkpoint belongs to this
+// job and the archive up to it is intact. Returns false to start over.
+bool loadResumeState(CompressionContext& context) {
+    Checkpoint checkpoint;
+    if (!readCheckpoint(context.checkpointFile, checkpoint) || checkpoint.jobHash != context.jobHash ||
+        checkpoint.offset == 0 || checkpoint.prefixBytes != checkpoint.offset) {
+        return false;
+    }
+
+    auto resume = std::make_unique<ResumeState>();
+    try {
+        std::error_code ec;
+        if (fs::file_size(context.outputFile, ec) < checkpoint.offset || ec ||
+            hashFileRange(context.outputFile, 0, checkpoint.offset, FNV_OFFSET_BASIS) != checkpoint.prefixHash) {
+            return false;
+        }
+        readResumedEntries(context.outputFile, checkpoint.offset, context.basePath, context.update.get(), *resume);
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (resume->entries.size() != checkpoint.entries ||
+        (!resume->entries.empty() && resume->entries.back().blocksDone != checkpoint.blocks)) {
+        return false;
+    }
+
+    context.files = std::move(resume->files);
+    context.blocks = std::move(resume->blocks);
+    context.blockOffsets = std::move(resume->blockOffsets);
+    context.nextBlockId = context.blockOffsets.size();
+    context.entriesWritten = checkpoint.entries;
+    context.resumePoint = checkpoint;
+    context.lastCheckpoint = checkpoint;
+    context.resume = std::move(resume);
+
+    LZ77_TRACE(LZ77_TRACE_INFO, "Resuming " << context.outputFile.string() << " at offset " << checkpoint.offset
+                                << " after " << checkpoint.entries << " entries");
+    return true;
+}
+
+// Walk a partial archive up to endOffset, rebuilding the reader's and writer's
+// deduplication state as the first run had it when it wrote those bytes
+void readResumedEntries(const fs::path& archivePath, uint64_t endOffset, const fs::path& basePath,
+                        const UpdateSource* update, ResumeState& resume) {
+    // Archives written by an older version are started over
+    std::ifstream infile(archivePath, std::ios::binary);
+    if (readArchiveHeader(infile) != ARCHIVE_VERSION) {
+        throw std::runtime_error("Invalid or corrupt partial archive.");
+    }
+
+    const std::streamoff end = static_cast<std::streamoff>(endOffset);
+    std::unordered_map<std::streamoff, uint64_t> blockHashes;  // By block header offset
+    std::vector<char> payload;
+    std::vector<char> blockData;
+    std::vector<char> filterScratch;
+    TokenStats tokenStats;
+
+    while (infile.tellg() < end) {
+        ResumedEntry entry;
+        infile.read(reinterpret_cast<char*>(&entry.type), sizeof(entry.type));
+        entry.path = readPath(infile, ARCHIVE_VERSION);
+
+        if (entry.type == EntryType::Link || entry.type == EntryType::BlockFile) {
+            entry.fileSize = readUInt64(infile);
+            entry.modifiedTime = static_cast<int64_t>(readUInt64(infile));
+            entry.contentHash = readUInt64(infile);
+        }
+
+        if (entry.type == EntryType::Link) {
+            readPath(infile, ARCHIVE_VERSION);
+        } else if (entry.type == EntryType::BlockFile) {
+            entry.settings.windowSize = static_cast<int>(readVarUInt(infile));
+            entry.settings.maxMatchLength = static_cast<int>(readVarUInt(infile));
+            entry.filters = readFilterChain(infile);
+            entry.numBlocks = readVarUInt(infile);
+            fs::path sourcePath = basePath / entry.path;
+            if (entry.fileSize > 0) {
+                resume.files.emplace(entry.contentHash, FileRef{ sourcePath, entry.path });
+            }
+
+            // Entries copied from the base archive in update mode keep its payloads and filters;
+            // the first run never offered their blocks for deduplication
+            bool copied = false;
+            if (update) {
+                auto it = update->entries.find(entry.path);
+                copied = it != update->entries.end() && it->second.fileSize == entry.fileSize &&
+                         it->second.modifiedTime == entry.modifiedTime && it->second.contentHash == entry.contentHash;
+            }
+
+            uint64_t sourceOffset = 0;
+            while (entry.blocksDone < entry.numBlocks && infile && infile.tellg() < end) {
+                std::streamoff blockOffset = infile.tellg();
+                BlockCodec codec;
+                infile.read(reinterpret_cast<char*>(&codec), sizeof(codec));
+                uint64_t rawSize = readVarUInt(infile);
+                uint64_t payloadSize = readVarUInt(infile);
+                if (rawSize > MAX_BLOCK_SIZE || payloadSize > MAX_BLOCK_SIZE) {
+                    throw std::runtime_error("Invalid block header in partial archive.");
+                }
+
+                if (codec == BlockCodec::Duplicate) {
+                    // Duplicates don't register blocks of their own
+                    auto it = blockHashes.find(static_cast<std::streamoff>(readUInt64(infile)));
+                    if (payloadSize != sizeof(uint64_t) || it == blockHashes.end()) {
+                        throw std::runtime_error("Invalid duplicate block reference in partial archive.");
+                    }
+                } else {
+                    const Codec* blockCodec = findCodec(codec);
+                    if (!blockCodec || !blockCodec->validSizes(payloadSize, rawSize)) {
+                        throw std::runtime_error("Invalid block header in partial archive.");
+                    }
+                    if (copied) {
+                        infile.seekg(static_cast<std::streamoff>(payloadSize), std::ios::cur);
+                    } else {
+                        payload.resize(payloadSize);
+                        infile.read(payload.data(), payloadSize);
+                        blockData.resize(rawSize);
+                        blockCodec->decompress(payload.data(), payload.size(), blockData.data(), blockData.size(), &tokenStats);
+                        if (codec != BlockCodec::Stored) {
+                            reverseFilters(entry.filters, blockData, filterScratch);
+                        }
+                        uint64_t blockHash = hashData(blockData.data(), blockData.size());
+
+                        blockHashes[blockOffset] = blockHash;
+                        size_t blockId = resume.blockOffsets.size();
+                        resume.blockOffsets.push_back(blockOffset);
+                        resume.blocks.emplace(blockHash, BlockRef{ sourcePath, sourceOffset, static_cast<uint32_t>(rawSize), blockId });
+                    }
+                }
+
+                sourceOffset += rawSize;
+                ++entry.blocksDone;
+            }
+        } else if (entry.type != EntryType::Directory) {
+            throw std::runtime_error("Unexpected entry type in partial archive.");
+        }
+
+        if (!infile) {
+            throw std::runtime_error("Unexpected end of partial archive.");
+        }
+        resume.entries.push_back(std::move(entry));
+    }
+
+    if (infile.tellg() != end) {
+        throw std::runtime_error("Checkpoint does not fall between blocks.");
+    }
+}
+
+// The next entry of a resumed archive, which must be the one the reader has reached.
+// Returns nullptr once the resumed entries run out.
+const ResumedEntry* nextResumedEntry(CompressionContext& context, const std::string& relativePath, bool directory) {
+    ResumeState* resume = context.resume.get();
+    if (!resume || resume->nextEntry == resume->entries.size()) {
+        return nullptr;
+    }
+
+    const ResumedEntry& entry = resume->entries[resume->nextEntry++];
+    if (entry.path != relativePath || (entry.type == EntryType::Directory) != directory) {
+        inputChanged(context);
+    }
+    return &entry;
+}
+
+// The partial archive no longer matches the input; it is discarded when the job fails
+void inputChanged(CompressionContext& context) {
+    context.inputChanged = true;
+    throw std::runtime_error("The input has changed since the interrupted run; run the job again to start over.");
+}
+
+// Record the latest resume point, once the archive up to it is on disk. The prefix hash
+// is carried forward from the previous checkpoint by reading back only the new bytes.
+void saveCheckpoint(CompressionContext& context) {
+    Checkpoint checkpoint = context.resumePoint;
+    const Checkpoint& last = context.lastCheckpoint;
+    context.lastCheckpointTime = std::chrono::steady_clock::now();
+    if (checkpoint.offset <= last.offset) {
+        return;
+    }
+
+    if (context.outfile.is_open()) {
+        context.outfile.flush();
+    }
+    checkpoint.jobHash = context.jobHash;
+    checkpoint.prefixBytes = checkpoint.offset;
+    checkpoint.prefixHash = hashFileRange(context.outputFile, last.prefixBytes, checkpoint.offset - last.prefixBytes,
+                                          last.prefixHash);
+    writeCheckpoint(context.checkpointFile, checkpoint);
+    context.lastCheckpoint = checkpoint;
+}
+
+std::string entryHeader(EntryType entryType, const std::string& relativePath) {
+    std::ostringstream header;
+    header.write(reinterpret_cast<char*>(&entryType), sizeof(entryType));
+
+    // Write relative path length and data
+    writeVarUInt(header, relativePath.length());
+    header.write(relativePath.c_str(), relativePath.length());
+    return header.str();
+}
+
+// Estimate compressibility from the order-0 entropy of a few slices spread across the data
+bool isLikelyIncompressible(const char* data, size_t size) {
+    const size_t SAMPLE_SLICES = 8;
+    const size_t SLICE_SIZE = 512;
+
+    size_t counts[256] = {};
+    size_t sampled = 0;
+
+    if (size <= SAMPLE_SLICES * SLICE_SIZE) {
+        for (size_t i = 0; i < size; ++i) {
+            ++counts[static_cast<uint8_t>(data[i])];
+        }
+        sampled = size;
+    } else {
+        size_t stride = size / SAMPLE_SLICES;
+        for (size_t slice = 0; slice < SAMPLE_SLICES; ++slice) {
+            const char* sliceData = data + slice * stride;
+            for (size_t i = 0; i < SLICE_SIZE; ++i) {
+                ++counts[static_cast<uint8_t>(sliceData[i])];
+            }
+        }
+        sampled = SAMPLE_SLICES * SLICE_SIZE;
+    }
+
+    if (sampled == 0) {
+        return false;
+    }
+
+    double entropy = 0.0;
+    for (size_t count : counts) {
+        if (count != 0) {
+            double p = static_cast<double>(count) / sampled;
+            entropy -= p * std::log2(p);
+        }
+    }
+
+    return entropy > INCOMPRESSIBLE_ENTROPY;
+}
+
+// Split data into blocks at content-defined cut points using a gear rolling hash
+std::vector<size_t> findChunkBoundaries(const char* data, size_t size) {
+    std::vector<size_t> boundaries;
+    size_t chunkStart = 0;
+    while (chunkStart < size) {
+        chunkStart += chunkLength(data + chunkStart, size - chunkStart);
+        boundaries.push_back(chunkStart);
+    }
+    return boundaries;
+}
+
+// Length of the chunk starting at data, with remaining bytes left in the input. Looks at
+// no more than MAX_CHUNK_SIZE bytes; the gear hash starts afresh at every chunk.
+size_t chunkLength(const char* data, size_t remaining) {
+    static const auto gear = []() {
+        std::array<uint64_t, 256> table{};
+        uint64_t state = 0x9E3779B97F4A7C15ULL;
+        for (auto& value : table) {
+            // splitmix64
+            state += 0x9E3779B97F4A7C15ULL;
+            uint64_t z = state;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            value = z ^ (z >> 31);
+        }
+        return table;
+    }();
+    const uint64_t cutMask = ~0ULL << (64 - CHUNK_CUT_BITS);
+
+    if (remaining <= MIN_CHUNK_SIZE) {
+        return remaining;
+    }
+
+    size_t limit = std::min(remaining, MAX_CHUNK_SIZE);
+    size_t pos = MIN_CHUNK_SIZE;
+    uint64_t hash = 0;
+    while (pos < limit) {
+        hash = (hash << 1) + gear[static_cast<uint8_t>(data[pos])];
+        ++pos;
+        if ((hash & cutMask) == 0) {
+            break;
+        }
+    }
+    return pos;
+}
+
+// Compare data against a region of a source file that was already archived
+bool sameContent(const fs::path& sourcePath, uint64_t sourceOffset, const char* data, size_t size) {
+    std::ifstream infile(sourcePath, std::ios::binary);
+    if (!infile) {
+        return false;
+    }
+    infile.seekg(static_cast<std::streamoff>(sourceOffset));
+
+    std::vector<char> buffer(64 * 1024);
+    size_t compared = 0;
+    while (compared < size) {
+        size_t chunk = std::min(buffer.size(), size - compared);
+        infile.read(buffer.data(), chunk);
+        if (!infile || !std::equal(buffer.begin(), buffer.begin() + chunk, data + compared)) {
+            return false;
+        }
+        compared += chunk;
+    }
+    return true;
+}
+
+// Compare the first size bytes of two files, for streamed files that aren't held in memory
+bool sameFileContent(const fs::path& sourcePath, const fs::path& filePath, uint64_t size) {
+    std::ifstream infile(filePath, std::ios::binary);
+    if (!infile) {
+        return false;
+    }
+
+    std::vector<char> buffer(1024 * 1024);
+    uint64_t compared = 0;
+    while (compared < size) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(buffer.size(), size - compared));
+        infile.read(buffer.data(), chunk);
+        if (!infile || !sameContent(sourcePath, compared, buffer.data(), chunk)) {
+            return false;
+        }
+        compared += chunk;
+    }
+    return true;
+}
+
+// Share a pooled buffer between pipeline items; it goes back to the pool once the
+// writer is done with the last of them
+std::shared_ptr<std::vector<char>> pooledBuffer(std::vector<char> data, BufferPool& buffers) {
+    BufferPool* pool = &buffers;
+    return std::shared_ptr<std::vector<char>>(new std::vector<char>(std::move(data)),
+                                              [pool](std::vector<char>* buffer) {
+                                                  pool->release(std::move(*buffer));
+                                                  delete buffer;
+                                              });
+}
+
+// Index the file entries of an existing archive by relative path
+void readArchiveIndex(const fs::path& archivePath, UpdateSource& update) {
+    update.archive.open(archivePath, std::ios::binary);
+    if (!update.archive) {
+        throw std::runtime_error("Failed to open base archive: " + archivePath.string());
+    }
+
+    std::ifstream& infile = update.archive;
+
+    // Verify header
+    update.version = readArchiveHeader(infile);
+    if (update.version == 0) {
+        throw std::runtime_error("Invalid or corrupt base archive.");
+    }
+
+    while (infile.peek() != EOF) {
+        EntryType entryType;
+        infile.read(reinterpret_cast<char*>(&entryType), sizeof(entryType));
+        std::string relativePath = readPath(infile, update.version);
+
+        if (entryType == EntryType::Directory) {
+            // Directory entry, nothing else to read
+        } else if (entryType == EntryType::File) {
+            // Legacy entries carry no metadata and are always recompressed
+            uint64_t numTokens = readSizeField(infile, update.version, 4);
+            infile.seekg(static_cast<std::streamoff>(numTokens * TOKEN_SIZE), std::ios::cur);
+        } else if (entryType == EntryType::Link) {
+            // Links are re-resolved against the new archive
+            infile.seekg(3 * sizeof(uint64_t), std::ios::cur);
+            readPath(infile, update.version);
+        } else if (entryType == EntryType::BlockFile) {
+            IndexEntry entry;
+            entry.fileSize = readUInt64(infile);
+            entry.modifiedTime = static_cast<int64_t>(readUInt64(infile));
+            entry.contentHash = readUInt64(infile);
+            if (update.version >= SETTINGS_ARCHIVE_VERSION) {
+                entry.settings.windowSize = static_cast<int>(readVarUInt(infile));
+                entry.settings.maxMatchLength = static_cast<int>(readVarUInt(infile));
+            }
+            if (update.version >= FILTERS_ARCHIVE_VERSION) {
+                entry.filters = readFilterChain(infile);
+            }
+            entry.blocksOffset = infile.tellg();
+
+            // Entries referencing blocks elsewhere in the archive can't be copied verbatim,
+            // and neither can those of an older version, whose headers differ
+            bool copyable = update.version == ARCHIVE_VERSION;
+            uint64_t numBlocks = readSizeField(infile, update.version, 4);
+            for (uint64_t block = 0; block < numBlocks && infile; ++block) {
+                BlockCodec codec;
+                infile.read(reinterpret_cast<char*>(&codec), sizeof(codec));
+                readSizeField(infile, update.version, 4); // Raw size
+                uint64_t payloadSize = readSizeField(infile, update.version, 4);
+                infile.seekg(static_cast<std::streamoff>(payloadSize), std::ios::cur);
+                copyable = copyable && codec != BlockCodec::Duplicate;
+            }
+
+            entry.blocksLength = infile.tellg() - entry.blocksOffset;
+            if (copyable) {
+                update.entries[relativePath] = entry;
+            }
+        } else {
+            throw std::runtime_error("Unknown entry type in base archive.");
+        }
+
+        if (!infile) {
+            throw std::runtime_error("Invalid or corrupt base archive.");
+        }
+    }
+
+    infile.clear();
+}
+
+// Archive path of an entry relative to the job's base path
+std::string relativeEntryPath(const fs::path& path, const fs::path& basePath) {
+    std::string relativePath = fs::relative(path, basePath).string();
+
+    // Ensure relativePath is not empty
+    if (relativePath.empty()) {
+        relativePath = path.filename().string();
+    }
+    return relativePath;
+}
+
+// Modification time in the filesystem clock's native ticks
+int64_t modifiedTime(const fs::path& filePath) {
+    return static_cast<int64_t>(fs::last_write_time(filePath).time_since_epoch().count());
+}
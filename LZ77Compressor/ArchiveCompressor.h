@@ -0,0 +1,61 @@
+#ifndef ARCHIVECOMPRESSOR_H
+#define ARCHIVECOMPRESSOR_H
+
+#include "ArchiveFormat.h"
+#include "Filters.h"
+#include "JobProgress.h"
+#include "JobStats.h"
+#include <cstddef>
+#include <string>
+
+// Compression levels select the match finder's window and match length
+const int MIN_COMPRESSION_LEVEL = 1;
+const int MAX_COMPRESSION_LEVEL = 9;
+const int DEFAULT_COMPRESSION_LEVEL = 4;
+
+struct CompressOptions {
+    std::string inputPath;
+    std::string outputFile;
+
+    // Build the output as an update of an existing archive: entries whose size and
+    // modification time (and optionally content hash) are unchanged are copied verbatim
+    std::string baseArchive;
+    bool compareHashes = false;
+
+    // Codec for blocks that shrink; others are stored. See registeredCodecs().
+    BlockCodec codec = BlockCodec::LZ77Repeat;
+
+    // Filters every file's blocks go through before the codec, such as delta:4 for
+    // 32-bit samples or x86 for executables. See Filters.h.
+    FilterChain filters;
+
+    int level = DEFAULT_COMPRESSION_LEVEL;
+    size_t threads = 0;   // Compressor threads; 0 uses one per hardware thread
+
+    // Choose match finder settings per file by compressing a sample of it with a few
+    // candidates, instead of using the level's; smaller files keep the level's settings.
+    // targetThroughput is the slowest acceptable speed in bytes per second per thread,
+    // or 0 to weigh ratio against CPU time. Tuned archives differ from run to run.
+    bool autoTune = false;
+    double targetThroughput = 0;
+
+    // Keep the job's buffers within this many bytes, lowering threads and read-ahead
+    // to fit; 0 for no limit. See planCompression().
+    size_t maxMemory = 0;
+
+    // Checkpoint the job next to the output file, and pick up an interrupted run of the
+    // same job from its last completed block instead of starting over
+    bool resume = true;
+};
+
+// Compress a file or directory tree into a MYARCH archive. Throws std::runtime_error on failure,
+// or JobCancelled once cancel is triggered. With options.resume the partial output is kept for
+// the next run to continue; otherwise it is removed.
+JobStats compressArchive(const CompressOptions &options, const ProgressCallback &progress = ProgressCallback(),
+                         const CancellationToken *cancel = nullptr);
+
+// Whether a sample of data looks too random to shrink; such blocks are stored without
+// running the codec
+bool isLikelyIncompressible(const char* data, size_t size);
+
+#endif // ARCHIVECOMPRESSOR_H
@@ -0,0 +1,972 @@
+#include "ArchiveExtractor.h"
+#include "ArchiveFormat.h"
+#include "FileBackend.h"
+#include "Filters.h"
+#include "BufferPool.h"
+#include "Checkpoint.h"
+#include "CodecRegistry.h"
+#include "JobProgress.h"
+#include "JobStats.h"
+#include "LZ77Codec.h"
+#include "MemoryBudget.h"
+#include "SimdKernels.h"
+#include <iostream>      // Added this line
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+// Location of an independently compressed block within the archive and the output file
+// Size and content hash of a file entry restored, or verified, earlier in the job
+struct RestoredFile {
+    uint64_t size;
+    uint64_t contentHash;
+};
+
+struct BlockInfo {
+    BlockCodec codec;
+    std::streamoff headerOffset;    // Block's codec byte
+    std::streamoff archiveOffset;   // Block's payload, or for a duplicate the payload it repeats
+    uint64_t outputOffset;
+    uint32_t rawSize;
+    uint32_t payloadSize;
+};
+
+// Files up to this size are decoded on the calling thread and written in batches of
+// up to IO_BATCH_FILES files, or the plan's batch bytes
+const uint64_t SMALL_FILE_SIZE = 256 * 1024;
+const size_t IO_BATCH_FILES = 64;
+
+// State shared by all entries of an extraction job
+struct ExtractionContext {
+    explicit ExtractionContext(const ExtractionPlan &plan)
+        : plan(plan), buffers(BufferPool::DEFAULT_RETAINED_BUFFERS, plan.retainedBytes) {}
+
+    ExtractionPlan plan;
+    std::string inputFile;
+    uint8_t version = 0;
+    uint64_t headerSize = 0;
+    std::string outputPath;
+    std::unique_ptr<FileBackend> io;
+    BufferPool buffers;
+    std::vector<char> payloadScratch;
+    std::vector<char> blockScratch;
+    std::vector<char> filterScratch;
+    FilterChain filters;          // Of the block file being decoded
+    std::vector<FileRequest> pendingWrites;
+    size_t pendingBytes = 0;
+    ProgressCallback progressCallback;
+    std::unique_ptr<ProgressReporter> progress;
+    const CancellationToken *cancel = nullptr;
+    JobStats stats;
+
+    // Test mode decodes and verifies entries without writing anything
+    bool testOnly = false;
+    // Files restored from this archive, the only ones a link may copy. Those an interrupted
+    // run restored have no hash here; copies of them are checked once written.
+    std::unordered_map<std::string, RestoredFile> restoredFiles;
+
+    // Checkpoints; checkpointFile is empty when they are off. Entries before
+    // resumePoint.offset are on disk, as are resumePoint.blocks blocks of partialFile.
+    fs::path checkpointFile;
+    uint64_t jobHash = 0;
+    uint64_t entriesDone = 0;
+    Checkpoint resumePoint;
+    Checkpoint lastCheckpoint;
+    fs::path partialFile;
+    std::chrono::steady_clock::time_point lastCheckpointTime;
+};
+
+// Function prototypes
+JobStats decompressArchive(ExtractionContext &context, const std::vector<ArchiveEntry> &entries);
+uint64_t extractionFingerprint(const ExtractionContext &context);
+bool loadCheckpoint(ExtractionContext &context, const std::vector<ArchiveEntry> &entries);
+void saveCheckpoint(ExtractionContext &context);
+void decompressEntry(std::ifstream &infile, ExtractionContext &context);
+uint64_t readBlockTable(std::ifstream &infile, uint8_t version, std::vector<BlockInfo> &blocks, uint64_t &tokenCount);
+void decompressBlocks(const std::string &inputFile, const fs::path &outputFile, const std::vector<BlockInfo> &blocks,
+                      size_t firstBlock, ExtractionContext &context);
+uint64_t verifyBlocks(std::ifstream &infile, const std::vector<BlockInfo> &blocks, ExtractionContext &context);
+void finishEntry(std::ifstream &infile, std::streamoff entryOffset, const std::string &relativePath,
+                 FileStats &fileStats, ExtractionContext &context);
+uint64_t remainingBytes(std::ifstream &infile);
+void decodeBlocksInMemory(std::ifstream &infile, const std::vector<BlockInfo> &blocks, std::vector<char> &data,
+                          ExtractionContext &context);
+const std::vector<char> &decodeBlock(const BlockInfo &block, const FilterChain &filters, const std::vector<char> &payload,
+                                     std::vector<char> &data, std::vector<char> &filterScratch, TokenStats &tokenStats);
+void queueWrite(ExtractionContext &context, const fs::path &fullPath, std::vector<char> data);
+void flushWrites(ExtractionContext &context);
+std::vector<char> decompressData(const std::vector<Token>& tokens);
+size_t extractionScratchBytes(const std::vector<ArchiveEntry> &entries);
+
+JobStats extractArchive(const ExtractOptions &options, const ProgressCallback &progress,
+                        const CancellationToken *cancel) {
+    // Listing the entries validates the archive's structure and tells which codecs it needs
+    std::vector<ArchiveEntry> entries = listArchive(options.inputFile);
+    ExtractionContext context(planExtraction(options.maxMemory, options.threads, extractionScratchBytes(entries)));
+    context.inputFile = options.inputFile;
+    context.outputPath = options.outputPath;
+    context.progressCallback = progress;
+    context.cancel = cancel;
+    if (options.resume) {
+        context.checkpointFile = checkpointPath(options.outputPath);
+    } else {
+        removeCheckpoint(checkpointPath(options.outputPath));
+    }
+    context.stats.operation = "extract";
+    return decompressArchive(context, entries);
+}
+
+JobStats testArchive(const std::string &inputFile, const ProgressCallback &progress,
+                     const CancellationToken *cancel) {
+    std::vector<ArchiveEntry> entries = listArchive(inputFile);
+    ExtractionContext context(planExtraction(0, 0, extractionScratchBytes(entries)));
+    context.inputFile = inputFile;
+    context.progressCallback = progress;
+    context.cancel = cancel;
+    context.testOnly = true;
+    context.stats.operation = "test";
+    return decompressArchive(context, entries);
+}
+
+std::vector<ArchiveEntry> listArchive(const std::string &inputFile) {
+    std::ifstream infile(inputFile, std::ios::binary);
+    if (!infile) {
+        throw std::runtime_error("Failed to open input file.");
+    }
+
+    // Verify header
+    uint8_t version = readArchiveHeader(infile);
+    if (version == 0) {
+        throw std::runtime_error("Invalid or corrupt compressed file.");
+    }
+
+    std::vector<ArchiveEntry> entries;
+    while (infile.peek() != EOF) {
+        std::streamoff entryOffset = infile.tellg();
+
+        ArchiveEntry entry;
+        infile.read(reinterpret_cast<char*>(&entry.type), sizeof(entry.type));
+        entry.path = readPath(infile, version);
+        if (!infile || !safeEntryPath(entry.path)) {
+            throw std::runtime_error("Invalid relative path in archive.");
+        }
+
+        if (entry.type == EntryType::Directory) {
+            // Directory entry, nothing else to read
+        } else if (entry.type == EntryType::File) {
+            uint64_t numTokens = readSizeField(infile, version, 4);
+            if (!infile || numTokens > remainingBytes(infile) / TOKEN_SIZE) {
+                throw std::runtime_error("Invalid token count in archive.");
+            }
+            // Skip tokens
+            infile.seekg(static_cast<std::streamoff>(numTokens * TOKEN_SIZE), std::ios::cur);
+            entry.size = 0;
+        } else if (entry.type == EntryType::BlockFile) {
+            entry.size = readUInt64(infile);
+            infile.seekg(2 * sizeof(uint64_t), std::ios::cur); // Modification time and hash
+            if (version >= SETTINGS_ARCHIVE_VERSION) {
+                readVarUInt(infile); // Window size
+                readVarUInt(infile); // Maximum match length
+            }
+            if (version >= FILTERS_ARCHIVE_VERSION) {
+                entry.filters = readFilterChain(infile);
+            }
+            uint64_t numBlocks = readSizeField(infile, version, 4);
+            for (uint64_t block = 0; block < numBlocks && infile; ++block) {
+                BlockCodec codec;
+                infile.read(reinterpret_cast<char*>(&codec), sizeof(codec));
+                if (codec != BlockCodec::Duplicate &&
+                    std::find(entry.codecs.begin(), entry.codecs.end(), codec) == entry.codecs.end()) {
+                    entry.codecs.push_back(codec);
+                }
+                uint64_t rawSize = readSizeField(infile, version, 4);
+                uint64_t payloadSize = readSizeField(infile, version, 4);
+                if (!infile || payloadSize > remainingBytes(infile)) {
+                    throw std::runtime_error("Unexpected end of archive.");
+                }
+                if (rawSize == 0 || rawSize > MAX_BLOCK_SIZE || payloadSize > MAX_BLOCK_SIZE) {
+                    throw std::runtime_error("Invalid block header in archive.");
+                }
+                // Skip payload
+                infile.seekg(static_cast<std::streamoff>(payloadSize), std::ios::cur);
+            }
+        } else if (entry.type == EntryType::Link) {
+            entry.size = readUInt64(infile);
+            infile.seekg(2 * sizeof(uint64_t), std::ios::cur); // Modification time and hash
+            entry.linkTarget = readPath(infile, version);
+            if (!infile || !safeEntryPath(entry.linkTarget)) {
+                throw std::runtime_error("Invalid link target in archive.");
+            }
+        } else {
+            throw std::runtime_error("Unknown entry type in archive.");
+        }
+
+        if (!infile) {
+            throw std::runtime_error("Unexpected end of archive.");
+        }
+        entry.storedBytes = static_cast<uint64_t>(infile.tellg() - entryOffset);
+        entries.push_back(std::move(entry));
+    }
+
+    return entries;
+}
+
+JobStats decompressArchive(ExtractionContext &context, const std::vector<ArchiveEntry> &entries) {
+    JobClock clock;
+
+    // Sum the restored sizes for progress tracking
+    uint64_t totalBytes = 0;
+    for (const auto &entry : entries) {
+        totalBytes += entry.size;
+    }
+    context.progress = std::make_unique<ProgressReporter>(context.progressCallback, totalBytes);
+
+    std::ifstream infile(context.inputFile, std::ios::binary);
+    context.version = readArchiveHeader(infile);
+    if (!infile || context.version == 0) {
+        throw std::runtime_error("Failed to open input file.");
+    }
+    context.headerSize = static_cast<uint64_t>(infile.tellg());
+
+    // Start after the header, or where an interrupted run of this job got to
+    context.resumePoint.offset = context.headerSize;
+    context.lastCheckpointTime = std::chrono::steady_clock::now();
+    if (!context.checkpointFile.empty()) {
+        context.jobHash = extractionFingerprint(context);
+        if (loadCheckpoint(context, entries)) {
+            for (size_t i = 0; i < context.entriesDone; ++i) {
+                context.progress->add(entries[i].size);
+                if (entries[i].type != EntryType::Directory) {
+                    context.restoredFiles[entries[i].path] = RestoredFile{ entries[i].size, 0 };
+                }
+            }
+            context.stats.resumedEntries = context.entriesDone;
+        }
+    }
+
+    context.io = createFileBackend();
+    context.stats.ioBackend = context.io->name();
+    context.stats.simdLevel = simdLevelName(simdKernels().level);
+
+    // Skip the header checked while listing, and any entries already restored
+    infile.seekg(static_cast<std::streamoff>(context.resumePoint.offset));
+
+    try {
+        while (infile.peek() != EOF) {
+            throwIfCancelled(context.cancel);
+
+            // Everything before this entry is on disk once no writes are pending
+            std::streamoff entryOffset = infile.tellg();
+            if (context.pendingWrites.empty() && static_cast<uint64_t>(entryOffset) != context.resumePoint.offset) {
+                context.resumePoint = Checkpoint();
+                context.resumePoint.offset = static_cast<uint64_t>(entryOffset);
+                context.resumePoint.entries = context.entriesDone;
+                if (!context.checkpointFile.empty() &&
+                    std::chrono::steady_clock::now() - context.lastCheckpointTime >= CHECKPOINT_INTERVAL) {
+                    saveCheckpoint(context);
+                }
+            }
+
+            decompressEntry(infile, context);
+            ++context.entriesDone;
+        }
+        flushWrites(context);
+    } catch (...) {
+        // Leave a checkpoint at the last point known to be on disk for the next run
+        if (!context.checkpointFile.empty()) {
+            try {
+                saveCheckpoint(context);
+            } catch (const std::exception &) {
+            }
+        }
+        throw;
+    }
+    context.progress.reset();
+    if (!context.checkpointFile.empty()) {
+        removeCheckpoint(context.checkpointFile);
+    }
+
+    infile.close();
+    context.stats.bytesIn = fs::file_size(context.inputFile);
+
+    JobStats &stats = context.stats;
+    for (const auto &file : stats.files) {
+        stats.bytesOut += file.bytesOut;
+    }
+    stats.buffers = context.buffers.stats();
+    clock.stop(stats);
+    return std::move(context.stats);
+}
+
+void decompressEntry(std::ifstream &infile, ExtractionContext &context) {
+    std::streamoff entryOffset = infile.tellg();
+    FileStats fileStats;
+
+    EntryType entryType;
+    infile.read(reinterpret_cast<char*>(&entryType), sizeof(entryType));
+
+    std::string relativePath = readPath(infile, context.version);
+
+    // Entries are only ever restored below the output directory
+    if (!infile || !safeEntryPath(relativePath)) {
+        throw std::runtime_error("Invalid relative path in archive.");
+    }
+
+    fs::path fullPath = fs::path(context.outputPath) / relativePath;
+
+    if (entryType == EntryType::Directory) {
+        if (!context.testOnly) {
+            // Create directory
+            std::error_code ec;
+            fs::create_directories(fullPath, ec);
+            if (ec) {
+                throw std::runtime_error("Failed to create directory: " + fullPath.string() + " Error: " + ec.message());
+            }
+        }
+    } else if (entryType == EntryType::File) {
+        // Read number of tokens
+        uint64_t numTokens = readSizeField(infile, context.version, 4);
+
+        // The count is untrusted; the tokens it promises must be in the file
+        if (!infile || numTokens == 0 || numTokens > remainingBytes(infile) / TOKEN_SIZE) {
+            throw std::runtime_error("Invalid token count in archive.");
+        }
+
+        // Read tokens
+        std::vector<Token> tokens(numTokens);
+        for (auto& token : tokens) {
+            token.offset = readUInt16(infile);
+            token.length = readUInt16(infile);
+            infile.read(&token.next_char, 1);
+        }
+
+        // Decompress data
+        std::vector<char> data;
+        {
+            StageTimer timer(context.stats.stages.decodingNanoseconds);
+            data = decompressData(tokens);
+        }
+        for (const auto& token : tokens) {
+            context.stats.tokens.add(token.offset, token.length);
+        }
+        fileStats.tokens = tokens.size();
+        fileStats.bytesOut = data.size();
+        context.restoredFiles[relativePath] = RestoredFile{ data.size(), hashData(data.data(), data.size()) };
+
+        if (context.testOnly) {
+            finishEntry(infile, entryOffset, relativePath, fileStats, context);
+            return;
+        }
+
+        // Write to file
+        std::error_code ec;
+        fs::create_directories(fullPath.parent_path(), ec);
+        if (ec) {
+            throw std::runtime_error("Failed to create directory: " + fullPath.parent_path().string() + " Error: " + ec.message());
+        }
+
+        queueWrite(context, fullPath, std::move(data));
+    } else if (entryType == EntryType::BlockFile) {
+        // Size and hash are checked against the restored data; the modification time is only used
+        // when updating archives, and the decoder doesn't need the match finder settings
+        uint64_t fileSize = readUInt64(infile);
+        infile.seekg(sizeof(uint64_t), std::ios::cur);
+        uint64_t contentHash = readUInt64(infile);
+        if (context.version >= SETTINGS_ARCHIVE_VERSION) {
+            readVarUInt(infile);
+            readVarUInt(infile);
+        }
+        context.filters.clear();
+        if (context.version >= FILTERS_ARCHIVE_VERSION) {
+            context.filters = readFilterChain(infile);
+        }
+
+        std::vector<BlockInfo> blocks;
+        uint64_t outputOffset = readBlockTable(infile, context.version, blocks, fileStats.tokens);
+        fileStats.bytesOut = outputOffset;
+
+        // Decoding buffers are sized from the block table, so it is held to the plan first
+        for (const auto &block : blocks) {
+            if (block.rawSize > context.plan.blockBytes || block.payloadSize > context.plan.blockBytes) {
+                throw std::runtime_error("Block of " + relativePath + " is larger than the memory budget allows.");
+            }
+        }
+
+        if (outputOffset != fileSize) {
+            throw std::runtime_error("Content check failed for " + relativePath + ".");
+        }
+        if (context.testOnly) {
+            if (verifyBlocks(infile, blocks, context) != contentHash) {
+                throw std::runtime_error("Content check failed for " + relativePath + ".");
+            }
+            context.restoredFiles[relativePath] = RestoredFile{ fileSize, contentHash };
+            finishEntry(infile, entryOffset, relativePath, fileStats, context);
+            return;
+        }
+
+        std::error_code ec;
+        fs::create_directories(fullPath.parent_path(), ec);
+        if (ec) {
+            throw std::runtime_error("Failed to create directory: " + fullPath.parent_path().string() + " Error: " + ec.message());
+        }
+
+        // Small files are decoded here and written together with their neighbours
+        if (outputOffset <= SMALL_FILE_SIZE) {
+            std::vector<char> data = context.buffers.acquire(outputOffset);
+            decodeBlocksInMemory(infile, blocks, data, context);
+            if (hashData(data.data(), data.size()) != contentHash) {
+                throw std::runtime_error("Content check failed for " + relativePath + ".");
+            }
+            context.progress->add(data.size());
+            queueWrite(context, fullPath, std::move(data));
+            context.restoredFiles[relativePath] = RestoredFile{ fileSize, contentHash };
+        } else {
+            // Earlier small files must be on disk before this file's blocks are checkpointed
+            flushWrites(context);
+
+            // An interrupted run may have restored the first blocks already; their hash is checked first
+            size_t firstBlock = 0;
+            const Checkpoint &resumed = context.resumePoint;
+            if (resumed.offset == static_cast<uint64_t>(entryOffset) && resumed.blocks > 0 &&
+                resumed.blocks <= blocks.size() && fs::is_regular_file(fullPath, ec) &&
+                fs::file_size(fullPath, ec) == outputOffset &&
+                hashFileRange(fullPath, 0, resumed.prefixBytes, FNV_OFFSET_BASIS) == resumed.prefixHash) {
+                firstBlock = resumed.blocks;
+                context.progress->add(resumed.prefixBytes);
+            } else {
+                // Create the output file at its final size so blocks can be written in place
+                {
+                    std::ofstream outfile(fullPath, std::ios::binary);
+                    if (!outfile) {
+                        throw std::runtime_error("Failed to create output file: " + fullPath.string());
+                    }
+                }
+                fs::resize_file(fullPath, outputOffset, ec);
+                if (ec) {
+                    throw std::runtime_error("Failed to resize output file: " + fullPath.string() + " Error: " + ec.message());
+                }
+
+                context.resumePoint = Checkpoint();
+                context.resumePoint.offset = static_cast<uint64_t>(entryOffset);
+                context.resumePoint.entries = context.entriesDone;
+            }
+            context.partialFile = fullPath;
+
+            // A file that fails to decode is removed rather than left at its full size; a
+            // cancelled one stays for the next run to resume
+            try {
+                decompressBlocks(context.inputFile, fullPath, blocks, firstBlock, context);
+            } catch (const JobCancelled &) {
+                throw;
+            } catch (...) {
+                fs::remove(fullPath, ec);
+                throw;
+            }
+
+            // Blocks finish out of order, so the restored file is read back for its hash
+            uint64_t restoredHash;
+            {
+                StageTimer timer(context.stats.stages.ioNanoseconds);
+                restoredHash = hashFileRange(fullPath, 0, outputOffset, FNV_OFFSET_BASIS);
+            }
+            if (restoredHash != contentHash) {
+                fs::remove(fullPath, ec);
+                throw std::runtime_error("Content check failed for " + relativePath + ".");
+            }
+            context.restoredFiles[relativePath] = RestoredFile{ fileSize, contentHash };
+        }
+    } else if (entryType == EntryType::Link) {
+        uint64_t fileSize = readUInt64(infile);
+        infile.seekg(sizeof(uint64_t), std::ios::cur);
+        uint64_t contentHash = readUInt64(infile);
+        fileStats.bytesOut = fileSize;
+
+        // The target must be a file restored earlier from this archive, never one outside it
+        std::string targetPath = readPath(infile, context.version);
+        if (!infile || !safeEntryPath(targetPath)) {
+            throw std::runtime_error("Invalid link target in archive.");
+        }
+        auto target = context.restoredFiles.find(targetPath);
+        if (target == context.restoredFiles.end()) {
+            throw std::runtime_error("Link target missing for " + relativePath + ".");
+        }
+        context.progress->add(fileSize);
+
+        if (context.testOnly) {
+            if (target->second.size != fileSize || target->second.contentHash != contentHash) {
+                throw std::runtime_error("Content check failed for " + relativePath + ".");
+            }
+            context.restoredFiles[relativePath] = RestoredFile{ fileSize, contentHash };
+            finishEntry(infile, entryOffset, relativePath, fileStats, context);
+            return;
+        }
+
+        std::error_code ec;
+        fs::create_directories(fullPath.parent_path(), ec);
+        if (ec) {
+            throw std::runtime_error("Failed to create directory: " + fullPath.parent_path().string() + " Error: " + ec.message());
+        }
+
+        // The target may still be waiting in the write batch
+        flushWrites(context);
+
+        StageTimer timer(context.stats.stages.ioNanoseconds);
+        fs::copy_file(fs::path(context.outputPath) / targetPath, fullPath, fs::copy_options::overwrite_existing, ec);
+        if (ec) {
+            throw std::runtime_error("Failed to restore linked file: " + fullPath.string() + " Error: " + ec.message());
+        }
+
+        // The copy is checked against the link's own record, as the target may predate this run
+        if (fs::file_size(fullPath, ec) != fileSize || ec ||
+            hashFileRange(fullPath, 0, fileSize, FNV_OFFSET_BASIS) != contentHash) {
+            fs::remove(fullPath, ec);
+            throw std::runtime_error("Content check failed for " + relativePath + ".");
+        }
+        context.restoredFiles[relativePath] = RestoredFile{ fileSize, contentHash };
+    } else {
+        throw std::runtime_error("Unknown entry type in archive.");
+    }
+
+    if (entryType != EntryType::Directory) {
+        finishEntry(infile, entryOffset, relativePath, fileStats, context);
+    }
+}
+
+// Record a restored or verified file
+void finishEntry(std::ifstream &infile, std::streamoff entryOffset, const std::string &relativePath,
+                 FileStats &fileStats, ExtractionContext &context) {
+    fileStats.path = relativePath;
+    fileStats.bytesIn = static_cast<uint64_t>(infile.tellg() - entryOffset);
+    context.stats.files.push_back(std::move(fileStats));
+}
+
+// Bytes between the read position and the end of the archive
+uint64_t remainingBytes(std::ifstream &infile) {
+    std::streamoff position = infile.tellg();
+    infile.seekg(0, std::ios::end);
+    std::streamoff end = infile.tellg();
+    infile.seekg(position);
+    return position < 0 || end < position ? 0 : static_cast<uint64_t>(end - position);
+}
+
+// Read a file entry's block table, leaving the stream after the last payload.
+// Duplicate blocks are pointed at the payload they repeat. Returns the file size.
+uint64_t readBlockTable(std::ifstream &infile, uint8_t version, std::vector<BlockInfo> &blocks, uint64_t &tokenCount) {
+    // Read the block table, skipping over the payloads. Blocks are grown one at a time,
+    // so a corrupt count fails on the missing headers rather than on allocation.
+    uint64_t numBlocks = readSizeField(infile, version, 4);
+
+    blocks.clear();
+    uint64_t outputOffset = 0;
+    for (uint64_t index = 0; index < numBlocks; ++index) {
+        BlockInfo block;
+        block.headerOffset = infile.tellg();
+        infile.read(reinterpret_cast<char*>(&block.codec), sizeof(block.codec));
+        uint64_t rawSize = readSizeField(infile, version, 4);
+        uint64_t payloadSize = readSizeField(infile, version, 4);
+        if (!infile || rawSize == 0 || rawSize > MAX_BLOCK_SIZE || payloadSize > MAX_BLOCK_SIZE) {
+            throw std::runtime_error("Invalid block header in archive.");
+        }
+        block.rawSize = static_cast<uint32_t>(rawSize);
+        block.payloadSize = static_cast<uint32_t>(payloadSize);
+        block.archiveOffset = infile.tellg();
+        block.outputOffset = outputOffset;
+
+        // Duplicates hold the offset of the block they repeat; everything else needs a known codec
+        const Codec *codec = findCodec(block.codec);
+        bool validPayload = block.codec == BlockCodec::Duplicate ? block.payloadSize == sizeof(uint64_t)
+                                                                 : codec && codec->validSizes(block.payloadSize, block.rawSize);
+        if (!infile || !validPayload) {
+            throw std::runtime_error("Invalid block header in archive.");
+        }
+
+        outputOffset += block.rawSize;
+        // Repeat-offset payloads start with their token count
+        if (block.codec == BlockCodec::LZ77) {
+            tokenCount += block.payloadSize / TOKEN_SIZE;
+        } else if (block.codec == BlockCodec::LZ77Repeat) {
+            tokenCount += readVarUInt(infile);
+        }
+        infile.seekg(block.archiveOffset + static_cast<std::streamoff>(block.payloadSize));
+        blocks.push_back(block);
+    }
+
+    // Point duplicate blocks at the payload of the block they repeat, which must be a
+    // block with a codec of its own that ends before the duplicate starts
+    for (auto& block : blocks) {
+        if (block.codec != BlockCodec::Duplicate) {
+            continue;
+        }
+        std::streamoff resumeOffset = infile.tellg();
+        infile.seekg(block.archiveOffset);
+        std::streamoff referencedOffset = static_cast<std::streamoff>(readUInt64(infile));
+        if (!infile || referencedOffset < 0 || referencedOffset >= block.headerOffset) {
+            throw std::runtime_error("Invalid duplicate block reference in archive.");
+        }
+
+        infile.seekg(referencedOffset);
+        infile.read(reinterpret_cast<char*>(&block.codec), sizeof(block.codec));
+        uint64_t rawSize = readSizeField(infile, version, 4);
+        uint64_t payloadSize = readSizeField(infile, version, 4);
+        block.archiveOffset = infile.tellg();
+
+        // Duplicates have no codec entry, so a duplicate of a duplicate fails here too
+        const Codec *codec = findCodec(block.codec);
+        if (!infile || !codec || rawSize != block.rawSize || payloadSize > MAX_BLOCK_SIZE ||
+            !codec->validSizes(static_cast<size_t>(payloadSize), block.rawSize) ||
+            block.archiveOffset + static_cast<std::streamoff>(payloadSize) > block.headerOffset) {
+            throw std::runtime_error("Invalid duplicate block reference in archive.");
+        }
+        block.payloadSize = static_cast<uint32_t>(payloadSize);
+        infile.seekg(resumeOffset);
+    }
+
+    return outputOffset;
+}
+
+// Decode a file's blocks one at a time and return the hash of the restored content
+uint64_t verifyBlocks(std::ifstream &infile, const std::vector<BlockInfo> &blocks, ExtractionContext &context) {
+    std::streamoff resumeOffset = infile.tellg();
+
+    std::vector<char> &payload = context.payloadScratch;
+    std::vector<char> &blockData = context.blockScratch;
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (const auto &block : blocks) {
+        throwIfCancelled(context.cancel);
+        payload.resize(block.payloadSize);
+        {
+            StageTimer timer(context.stats.stages.ioNanoseconds);
+            infile.seekg(block.archiveOffset);
+            infile.read(payload.data(), payload.size());
+        }
+        if (!infile) {
+            throw std::runtime_error("Unexpected end of archive while reading block.");
+        }
+
+        const std::vector<char> *decoded;
+        {
+            StageTimer timer(context.stats.stages.decodingNanoseconds);
+            decoded = &decodeBlock(block, context.filters, payload, blockData, context.filterScratch,
+                                   context.stats.tokens);
+        }
+        hash = hashData(decoded->data(), decoded->size(), hash);
+        context.progress->add(block.rawSize);
+    }
+
+    infile.seekg(resumeOffset);
+    return hash;
+}
+
+// Decode all blocks of a small file on the calling thread, leaving the stream where it was
+void decodeBlocksInMemory(std::ifstream &infile, const std::vector<BlockInfo> &blocks, std::vector<char> &data,
+                          ExtractionContext &context) {
+    std::streamoff resumeOffset = infile.tellg();
+
+    std::vector<char> &payload = context.payloadScratch;
+    std::vector<char> &blockData = context.blockScratch;
+    for (const auto &block : blocks) {
+        throwIfCancelled(context.cancel);
+        payload.resize(block.payloadSize);
+        {
+            StageTimer timer(context.stats.stages.ioNanoseconds);
+            infile.seekg(block.archiveOffset);
+            infile.read(payload.data(), payload.size());
+        }
+        if (!infile) {
+            throw std::runtime_error("Unexpected end of archive while reading block.");
+        }
+
+        const std::vector<char> *decoded;
+        {
+            StageTimer timer(context.stats.stages.decodingNanoseconds);
+            decoded = &decodeBlock(block, context.filters, payload, blockData, context.filterScratch,
+                                   context.stats.tokens);
+        }
+        data.insert(data.end(), decoded->begin(), decoded->end());
+    }
+
+    infile.seekg(resumeOffset);
+}
+
+// Decode a block with the codec it names and undo the entry's filters, or hand back
+// the payload itself for stored blocks
+const std::vector<char> &decodeBlock(const BlockInfo &block, const FilterChain &filters, const std::vector<char> &payload,
+                                     std::vector<char> &data, std::vector<char> &filterScratch, TokenStats &tokenStats) {
+    if (block.codec == BlockCodec::Stored) {
+        return payload;
+    }
+
+    data.resize(block.rawSize);
+    findCodec(block.codec)->decompress(payload.data(), payload.size(), data.data(), block.rawSize, &tokenStats);
+    reverseFilters(filters, data, filterScratch);
+    return data;
+}
+
+// Scratch a decoding thread needs for the hungriest codec the archive uses, plus a
+// block for undoing record filters
+size_t extractionScratchBytes(const std::vector<ArchiveEntry> &entries) {
+    size_t codecBytes = 0;
+    size_t filterBytes = 0;
+    for (const auto &entry : entries) {
+        for (BlockCodec id : entry.codecs) {
+            if (const Codec *codec = findCodec(id)) {
+                codecBytes = std::max(codecBytes, codec->decodeWorkspaceBytes(MAX_BLOCK_SIZE));
+            }
+        }
+        if (!entry.filters.empty()) {
+            filterBytes = MAX_BLOCK_SIZE;
+        }
+    }
+    return codecBytes + filterBytes;
+}
+
+void queueWrite(ExtractionContext &context, const fs::path &fullPath, std::vector<char> data) {
+    context.pendingBytes += data.size();
+
+    FileRequest request;
+    request.path = fullPath;
+    request.data = std::move(data);
+    context.pendingWrites.push_back(std::move(request));
+
+    if (context.pendingWrites.size() >= IO_BATCH_FILES || context.pendingBytes >= context.plan.batchBytes) {
+        flushWrites(context);
+    }
+}
+
+// Write out every queued file through the I/O backend
+void flushWrites(ExtractionContext &context) {
+    if (context.pendingWrites.empty()) {
+        return;
+    }
+    {
+        StageTimer timer(context.stats.stages.ioNanoseconds);
+        context.io->writeFiles(context.pendingWrites);
+    }
+    for (auto &request : context.pendingWrites) {
+        context.buffers.release(std::move(request.data));
+    }
+    context.pendingWrites.clear();
+    context.pendingBytes = 0;
+}
+
+// Definition of decompressData
+std::vector<char> decompressData(const std::vector<Token>& tokens) {
+    std::vector<char> data;
+
+    for (const auto& token : tokens) {
+        if (token.offset == 0 && token.length == 0) {
+            if (token.next_char != '\0') {
+                data.push_back(token.next_char);
+            }
+        } else {
+            if (token.offset > data.size()) {
+                std::cerr << "Invalid token offset: " << token.offset << ", data size: " << data.size() << std::endl;
+                throw std::runtime_error("Invalid token offset in compressed data.");
+            }
+            size_t start = data.size() - token.offset;
+            for (size_t i = 0; i < token.length; ++i) {
+                data.push_back(data[start + i]);
+            }
+            if (token.next_char != '\0') {
+                data.push_back(token.next_char);
+            }
+        }
+    }
+
+    return data;
+}
+
+// Decode blocks on a pool of threads, each writing straight into its position in the output
+void decompressBlocks(const std::string &inputFile, const fs::path &outputFile, const std::vector<BlockInfo> &blocks,
+                      size_t firstBlock, ExtractionContext &context) {
+    if (firstBlock >= blocks.size()) {
+        return;
+    }
+
+    size_t numThreads = std::min(context.plan.threads, blocks.size() - firstBlock);
+
+    // Blocks finish out of order; only the run completed from the start can be checkpointed
+    std::vector<char> blockDone(blocks.size());
+    size_t doneBlocks = firstBlock;
+
+    std::atomic<size_t> nextBlock(firstBlock);
+    std::exception_ptr firstError;
+    std::mutex errorMutex;
+    BufferPool &buffers = context.buffers;
+    JobStats &stats = context.stats;
+
+    auto decodeWorker = [&]() {
+        TokenStats tokenStats;
+        StageTimes times;
+        try {
+            // Every thread has its own handles so seeks don't interfere
+            std::ifstream archive(inputFile, std::ios::binary);
+            std::fstream output(outputFile, std::ios::binary | std::ios::in | std::ios::out);
+            if (!archive || !output) {
+                throw std::runtime_error("Failed to open files for block decoding: " + outputFile.string());
+            }
+
+            std::vector<char> payload = buffers.acquire(BLOCK_SIZE);
+            std::vector<char> data = buffers.acquire(BLOCK_SIZE);
+            std::vector<char> filterScratch;
+
+            for (size_t index = nextBlock++; index < blocks.size(); index = nextBlock++) {
+                const BlockInfo& block = blocks[index];
+                throwIfCancelled(context.cancel);
+
+                payload.resize(block.payloadSize);
+                {
+                    StageTimer timer(times.ioNanoseconds);
+                    archive.seekg(block.archiveOffset);
+                    archive.read(payload.data(), payload.size());
+                }
+                if (!archive) {
+                    throw std::runtime_error("Unexpected end of archive while reading block.");
+                }
+
+                // Stored blocks are written straight from the payload
+                const std::vector<char>* blockData;
+                {
+                    StageTimer timer(times.decodingNanoseconds);
+                    blockData = &decodeBlock(block, context.filters, payload, data, filterScratch, tokenStats);
+                }
+
+                {
+                    StageTimer timer(times.ioNanoseconds);
+                    output.seekp(static_cast<std::streamoff>(block.outputOffset));
+                    output.write(blockData->data(), blockData->size());
+                }
+                output.flush();
+                if (!output) {
+                    throw std::runtime_error("Failed to write output file: " + outputFile.string());
+                }
+                context.progress->add(block.rawSize);
+
+                std::lock_guard<std::mutex> lock(errorMutex);
+                blockDone[index] = 1;
+                while (doneBlocks < blocks.size() && blockDone[doneBlocks]) {
+                    ++doneBlocks;
+                }
+                // Blocks finished ahead of the first one don't move the resume point
+                if (doneBlocks > 0) {
+                    context.resumePoint.blocks = static_cast<uint32_t>(doneBlocks);
+                    context.resumePoint.prefixBytes = blocks[doneBlocks - 1].outputOffset + blocks[doneBlocks - 1].rawSize;
+                }
+                if (!context.checkpointFile.empty() &&
+                    std::chrono::steady_clock::now() - context.lastCheckpointTime >= CHECKPOINT_INTERVAL) {
+                    saveCheckpoint(context);
+                }
+            }
+
+            buffers.release(std::move(payload));
+            buffers.release(std::move(data));
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!firstError) {
+                firstError = std::current_exception();
+            }
+            // Stop the other threads from picking up more work
+            nextBlock = blocks.size();
+        }
+
+        std::lock_guard<std::mutex> lock(errorMutex);
+        stats.tokens.merge(tokenStats);
+        stats.stages.merge(times);
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < numThreads; ++i) {
+        threads.emplace_back(decodeWorker);
+    }
+    decodeWorker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (firstError) {
+        std::rethrow_exception(firstError);
+    }
+}
+
+// Fingerprint of the archive and destination, so that a checkpoint is only ever resumed by the same job
+uint64_t extractionFingerprint(const ExtractionContext &context) {
+    std::ostringstream job;
+    job << fs::absolute(context.inputFile).lexically_normal().string() << '\n'
+        << fs::file_size(context.inputFile) << '\n'
+        << fs::last_write_time(context.inputFile).time_since_epoch().count() << '\n'
+        << fs::absolute(context.outputPath).lexically_normal().string();
+    std::string text = job.str();
+    return hashData(text.data(), text.size());
+}
+
+// Take over where an interrupted run of this job stopped, if every entry it completed
+// is still in place at its restored size. Returns false to start from the first entry.
+bool loadCheckpoint(ExtractionContext &context, const std::vector<ArchiveEntry> &entries) {
+    Checkpoint checkpoint;
+    if (!readCheckpoint(context.checkpointFile, checkpoint) || checkpoint.jobHash != context.jobHash ||
+        checkpoint.entries > entries.size()) {
+        return false;
+    }
+
+    uint64_t offset = context.headerSize;
+    for (size_t i = 0; i < checkpoint.entries; ++i) {
+        const ArchiveEntry &entry = entries[i];
+        fs::path fullPath = fs::path(context.outputPath) / entry.path;
+        std::error_code ec;
+        bool restored = entry.type == EntryType::Directory
+            ? fs::is_directory(fullPath, ec)
+            : fs::is_regular_file(fullPath, ec) &&
+              (entry.type == EntryType::File || fs::file_size(fullPath, ec) == entry.size);
+        if (!restored) {
+            return false;
+        }
+        offset += entry.storedBytes;
+    }
+    if (offset != checkpoint.offset) {
+        return false;
+    }
+
+    context.entriesDone = checkpoint.entries;
+    context.resumePoint = checkpoint;
+    context.lastCheckpoint = checkpoint;
+    return true;
+}
+
+// Record the latest resume point. The partial file's prefix hash is carried forward
+// from the previous checkpoint of the same file by reading back only the new blocks.
+void saveCheckpoint(ExtractionContext &context) {
+    Checkpoint checkpoint = context.resumePoint;
+    context.lastCheckpointTime = std::chrono::steady_clock::now();
+    if (checkpoint.entries == 0 && checkpoint.blocks == 0) {
+        return;
+    }
+
+    checkpoint.jobHash = context.jobHash;
+    if (checkpoint.blocks == 0) {
+        checkpoint.prefixBytes = 0;
+        checkpoint.prefixHash = FNV_OFFSET_BASIS;
+    } else {
+        Checkpoint last = context.lastCheckpoint;
+        if (last.offset != checkpoint.offset || last.blocks == 0 || last.prefixBytes > checkpoint.prefixBytes) {
+            last.prefixBytes = 0;
+            last.prefixHash = FNV_OFFSET_BASIS;
+        }
+        checkpoint.prefixHash = hashFileRange(context.partialFile, last.prefixBytes,
+                                              checkpoint.prefixBytes - last.prefixBytes, last.prefixHash);
+    }
+
+    writeCheckpoint(context.checkpointFile, checkpoint);
+    context.lastCheckpoint = checkpoint;
+}
@@ -0,0 +1,48 @@
+#ifndef ARCHIVEEXTRACTOR_H
+#define ARCHIVEEXTRACTOR_H
+
+#include "ArchiveCompressor.h"
+#include "ArchiveFormat.h"
+#include "JobStats.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Summary of one archive entry, as read from its headers
+struct ArchiveEntry {
+    EntryType type;
+    std::string path;
+    uint64_t size = 0;          // Uncompressed size of a file
+    uint64_t storedBytes = 0;   // Bytes the entry takes up in the archive
+    std::string linkTarget;     // File a link entry restores a copy of
+    std::vector<BlockCodec> codecs;   // Codecs a block file's blocks use, in order of first use
+    FilterChain filters;              // Filters a block file's blocks went through
+};
+
+struct ExtractOptions {
+    std::string inputFile;
+    std::string outputPath;
+    size_t threads = 0;   // Block decoding threads for large files; 0 uses one per hardware thread
+
+    // Checkpoint the job next to outputPath, and have a re-run after an interruption
+    // skip what is already restored
+    bool resume = true;
+
+    // Keep the job's buffers within this many bytes, lowering threads and write
+    // batches to fit; 0 for no limit. See planExtraction().
+    size_t maxMemory = 0;
+};
+
+// Restore every entry of an archive below options.outputPath. Throws std::runtime_error
+// on failure, or JobCancelled once cancel is triggered.
+JobStats extractArchive(const ExtractOptions &options, const ProgressCallback &progress = ProgressCallback(),
+                        const CancellationToken *cancel = nullptr);
+
+// Read the entry headers of an archive without decoding any data
+std::vector<ArchiveEntry> listArchive(const std::string &inputFile);
+
+// Decode every entry in memory and check it against its stored size and content hash
+JobStats testArchive(const std::string &inputFile, const ProgressCallback &progress = ProgressCallback(),
+                     const CancellationToken *cancel = nullptr);
+
+#endif // ARCHIVEEXTRACTOR_H
@@ -0,0 +1,156 @@
+#include "ArchiveFormat.h"
+#include <filesystem>
+#include <stdexcept>
+
+// Functions to write integers in little-endian format
+void writeUInt16(std::ostream& stream, uint16_t value) {
+    uint8_t bytes[2];
+    bytes[0] = value & 0xFF;
+    bytes[1] = (value >> 8) & 0xFF;
+    stream.write(reinterpret_cast<char*>(bytes), 2);
+}
+
+void writeUInt32(std::ostream& stream, uint32_t value) {
+    uint8_t bytes[4];
+    bytes[0] = value & 0xFF;
+    bytes[1] = (value >> 8) & 0xFF;
+    bytes[2] = (value >> 16) & 0xFF;
+    bytes[3] = (value >> 24) & 0xFF;
+    stream.write(reinterpret_cast<char*>(bytes), 4);
+}
+
+void writeUInt64(std::ostream& stream, uint64_t value) {
+    writeUInt32(stream, static_cast<uint32_t>(value & 0xFFFFFFFF));
+    writeUInt32(stream, static_cast<uint32_t>(value >> 32));
+}
+
+// Functions to read integers in little-endian format
+uint16_t readUInt16(std::istream& stream) {
+    uint8_t bytes[2];
+    stream.read(reinterpret_cast<char*>(bytes), 2);
+    return static_cast<uint16_t>(bytes[0]) | (static_cast<uint16_t>(bytes[1]) << 8);
+}
+
+uint32_t readUInt32(std::istream& stream) {
+    uint8_t bytes[4];
+    stream.read(reinterpret_cast<char*>(bytes), 4);
+    return static_cast<uint32_t>(bytes[0]) |
+           (static_cast<uint32_t>(bytes[1]) << 8) |
+           (static_cast<uint32_t>(bytes[2]) << 16) |
+           (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+uint64_t readUInt64(std::istream& stream) {
+    uint64_t low = readUInt32(stream);
+    uint64_t high = readUInt32(stream);
+    return low | (high << 32);
+}
+
+void writeVarUInt(std::ostream& stream, uint64_t value) {
+    uint8_t bytes[10];
+    size_t count = 0;
+    while (value >= 0x80) {
+        bytes[count++] = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    bytes[count++] = static_cast<uint8_t>(value);
+    stream.write(reinterpret_cast<char*>(bytes), count);
+}
+
+uint64_t readVarUInt(std::istream& stream) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = stream.get();
+        if (byte == EOF) {
+            return 0;
+        }
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            // The tenth byte only has room for the top bit
+            if (shift == 63 && byte > 1) {
+                break;
+            }
+            return value;
+        }
+    }
+    stream.setstate(std::ios::failbit);
+    return 0;
+}
+
+size_t varUIntSize(uint64_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+void writeArchiveHeader(std::ostream& stream) {
+    stream.write("MYARCH", 6);
+    stream.put('\0');
+    stream.put(static_cast<char>(ARCHIVE_VERSION));
+}
+
+uint8_t readArchiveHeader(std::istream& stream) {
+    char magic[6];
+    stream.read(magic, 6);
+    if (!stream || std::string(magic, 6) != "MYARCH") {
+        return 0;
+    }
+
+    // Version 1 archives have an entry type, or nothing, where the marker would be
+    if (stream.peek() != 0) {
+        return LEGACY_ARCHIVE_VERSION;
+    }
+    stream.get();
+    int version = stream.get();
+    if (version == EOF || version <= LEGACY_ARCHIVE_VERSION) {
+        return 0;
+    }
+    if (version > ARCHIVE_VERSION) {
+        throw std::runtime_error("Archive format version " + std::to_string(version) +
+                                 " is newer than this program supports.");
+    }
+    return static_cast<uint8_t>(version);
+}
+
+uint64_t readSizeField(std::istream& stream, uint8_t version, size_t legacyBytes) {
+    if (version != LEGACY_ARCHIVE_VERSION) {
+        return readVarUInt(stream);
+    }
+    return legacyBytes == 2 ? readUInt16(stream) : readUInt32(stream);
+}
+
+std::string readPath(std::istream& stream, uint8_t version) {
+    uint64_t length = readSizeField(stream, version, 2);
+    if (!stream || length > MAX_PATH_LENGTH) {
+        stream.setstate(std::ios::failbit);
+        return std::string();
+    }
+
+    std::string path(static_cast<size_t>(length), '\0');
+    stream.read(&path[0], path.size());
+    return path;
+}
+
+bool safeEntryPath(const std::string& path) {
+    std::filesystem::path entryPath(path);
+    if (path.empty() || entryPath.has_root_name() || entryPath.has_root_directory()) {
+        return false;
+    }
+    for (const auto& component : entryPath) {
+        if (component == "..") {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t hashData(const char* data, size_t size, uint64_t hash) {
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,108 @@
+#ifndef ARCHIVEFORMAT_H
+#define ARCHIVEFORMAT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <string>
+
+// Ensure the Token structure is packed without padding
+#pragma pack(push, 1)
+struct Token {
+    uint16_t offset;
+    uint16_t length;
+    char next_char;
+};
+#pragma pack(pop)
+
+// Serialized size of a token: offset, length and next character
+const size_t TOKEN_SIZE = 5;
+
+// Archives start with the MYARCH magic. Version 1 archives go straight on to their
+// first entry and use 16-bit path lengths and 32-bit counts and sizes; from version 2
+// the magic is followed by a zero byte, which no entry type uses, and the version,
+// and every length, count and size is a varint. Version 3 adds the match finder
+// settings a block file was compressed with, as two varints after its content hash.
+// Version 4 follows them with the block file's filter chain (see Filters.h).
+const uint8_t LEGACY_ARCHIVE_VERSION = 1;
+const uint8_t SETTINGS_ARCHIVE_VERSION = 3;
+const uint8_t FILTERS_ARCHIVE_VERSION = 4;
+const uint8_t ARCHIVE_VERSION = 4;
+
+// Entry and link paths longer than this are taken for a corrupt length
+const uint64_t MAX_PATH_LENGTH = 1024 * 1024;
+
+// Archive entry types
+enum class EntryType : uint8_t {
+    File = 0x01,
+    Directory = 0x02,
+    BlockFile = 0x03,
+    Link = 0x04
+};
+
+// Block codecs. LZ77 blocks hold fixed 5-byte tokens, LZ77Repeat ones the shorter
+// repeat-offset tokens of LZ77Codec.h.
+enum class BlockCodec : uint8_t {
+    LZ77 = 0x00,
+    Stored = 0x01,
+    Duplicate = 0x02,
+    BWT = 0x03,
+    LZ77Repeat = 0x04
+};
+
+// Preprocessing filters. They apply to a block file's codec-encoded blocks only; stored
+// blocks hold the raw bytes. A duplicate block only repeats one with the same filters.
+enum class FilterType : uint8_t {
+    Delta = 0x00,
+    X86 = 0x01,
+    Records = 0x02
+};
+
+// Files are split into independently compressed blocks of about this size so
+// that the decompressor can restore them in parallel
+const size_t BLOCK_SIZE = 1024 * 1024;
+
+// Content-defined block boundaries keep every block at or below this size
+const size_t MAX_BLOCK_SIZE = BLOCK_SIZE * 2;
+
+// Functions to write integers in little-endian format
+void writeUInt16(std::ostream& stream, uint16_t value);
+void writeUInt32(std::ostream& stream, uint32_t value);
+void writeUInt64(std::ostream& stream, uint64_t value);
+
+// Functions to read integers in little-endian format
+uint16_t readUInt16(std::istream& stream);
+uint32_t readUInt32(std::istream& stream);
+uint64_t readUInt64(std::istream& stream);
+
+// Variable-length unsigned integers (LEB128): seven bits per byte, least significant
+// first, with the top bit set on every byte but the last. A malformed varint fails the stream.
+void writeVarUInt(std::ostream& stream, uint64_t value);
+uint64_t readVarUInt(std::istream& stream);
+size_t varUIntSize(uint64_t value);
+
+// Write the header of a current-version archive
+void writeArchiveHeader(std::ostream& stream);
+
+// Read an archive header and return its version, or 0 if the stream isn't an archive.
+// Throws std::runtime_error for a version newer than this build understands.
+uint8_t readArchiveHeader(std::istream& stream);
+
+// Read a length, count or size field: a varint, or in version 1 archives a fixed
+// little-endian integer of legacyBytes (2 or 4) bytes
+uint64_t readSizeField(std::istream& stream, uint8_t version, size_t legacyBytes);
+
+// Read a length-prefixed entry or link path; fails the stream if the length is out of range
+std::string readPath(std::istream& stream, uint8_t version);
+
+// Whether an entry or link path stays below the directory it is restored into: not empty
+// or absolute, and without a root name or a .. component
+bool safeEntryPath(const std::string& path);
+
+// 64-bit FNV-1a hash of file contents, stored with each file entry. Passing the
+// previous result as the seed hashes data that arrives in pieces.
+const uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+uint64_t hashData(const char* data, size_t size, uint64_t hash = FNV_OFFSET_BASIS);
+
+#endif // ARCHIVEFORMAT_H
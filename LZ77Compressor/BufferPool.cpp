@@ -0,0 +1,67 @@
+#include "BufferPool.h"
+#include <algorithm>
+
+BufferPool::BufferPool(size_t maxRetainedBuffers, size_t maxRetainedBytes)
+    : m_maxRetainedBuffers(maxRetainedBuffers), m_maxRetainedBytes(maxRetainedBytes),
+      m_retainedBytes(0), m_outstandingBytes(0) {}
+
+std::vector<char> BufferPool::acquire(size_t capacity) {
+    std::vector<char> buffer;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // Take the smallest retained buffer that is big enough, or else the largest one
+        auto fit = m_free.end();
+        auto largest = m_free.end();
+        for (auto it = m_free.begin(); it != m_free.end(); ++it) {
+            if (it->capacity() >= capacity && (fit == m_free.end() || it->capacity() < fit->capacity())) {
+                fit = it;
+            }
+            if (largest == m_free.end() || it->capacity() > largest->capacity()) {
+                largest = it;
+            }
+        }
+        auto best = fit != m_free.end() ? fit : largest;
+        if (best != m_free.end()) {
+            buffer = std::move(*best);
+            m_free.erase(best);
+            m_retainedBytes -= buffer.capacity();
+        }
+
+        if (buffer.capacity() >= capacity && buffer.capacity() > 0) {
+            ++m_stats.reuses;
+        } else {
+            ++m_stats.allocations;
+        }
+    }
+
+    buffer.clear();
+    buffer.reserve(capacity);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_stats.outstanding;
+    m_outstandingBytes += buffer.capacity();
+    m_stats.peakOutstanding = std::max(m_stats.peakOutstanding, m_stats.outstanding);
+    m_stats.peakBytes = std::max(m_stats.peakBytes, m_outstandingBytes);
+    return buffer;
+}
+
+void BufferPool::release(std::vector<char>&& buffer) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stats.outstanding > 0) {
+        --m_stats.outstanding;
+    }
+    m_outstandingBytes -= std::min(m_outstandingBytes, buffer.capacity());
+
+    if (buffer.capacity() == 0 || m_free.size() >= m_maxRetainedBuffers ||
+        m_retainedBytes + buffer.capacity() > m_maxRetainedBytes) {
+        return;
+    }
+    m_retainedBytes += buffer.capacity();
+    m_free.push_back(std::move(buffer));
+}
+
+BufferPool::Stats BufferPool::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
@@ -0,0 +1,43 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Recycles byte buffers across files and blocks of a job so that steady-state
+// processing reuses capacity instead of going back to the allocator every time
+class BufferPool {
+public:
+    struct Stats {
+        size_t allocations = 0;       // Requests that needed new or grown storage
+        size_t reuses = 0;            // Requests served from a recycled buffer
+        size_t outstanding = 0;       // Buffers currently handed out
+        size_t peakOutstanding = 0;
+        size_t peakBytes = 0;         // Largest total capacity handed out at once
+    };
+
+    static const size_t DEFAULT_RETAINED_BUFFERS = 64;
+
+    explicit BufferPool(size_t maxRetainedBuffers = DEFAULT_RETAINED_BUFFERS,
+                        size_t maxRetainedBytes = 64 * 1024 * 1024);
+
+    // Returns an empty buffer with at least the given capacity
+    std::vector<char> acquire(size_t capacity);
+
+    // Hands a buffer back; it is kept for reuse unless the pool is already full
+    void release(std::vector<char>&& buffer);
+
+    Stats stats() const;
+
+private:
+    size_t m_maxRetainedBuffers;
+    size_t m_maxRetainedBytes;
+    size_t m_retainedBytes;
+    size_t m_outstandingBytes;
+    std::vector<std::vector<char>> m_free;
+    Stats m_stats;
+    mutable std::mutex m_mutex;
+};
+
+#endif // BUFFERPOOL_H
@@ -0,0 +1,620 @@
+#include "BwtCodec.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// Move-to-front output: zero runs as bijective base-2 digits RUNA (1) and RUNB (2),
+// other positions v as v + 1
+const uint16_t RUNA = 0;
+const uint16_t RUNB = 1;
+const size_t ALPHABET_SIZE = 257;
+
+// Huffman tables: one per GROUP_SIZE symbols, chosen among at most MAX_TABLES
+const size_t GROUP_SIZE = 50;
+const size_t MIN_TABLES = 2;
+const size_t MAX_TABLES = 6;
+const int MAX_CODE_LENGTH = 17;
+const int CODE_LENGTH_BITS = 5;
+const int TABLE_ITERATIONS = 4;
+
+// The decoder keeps a row index and a byte in each 32-bit entry
+const size_t MAX_BWT_BLOCK_SIZE = (1u << 24) - 1;
+
+void writeLE32(std::vector<char>& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+uint32_t readLE32(const char* in) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(in);
+    return static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8) |
+           (static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+// Most significant bit first
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<char>& out) : m_out(out), m_buffer(0), m_bits(0) {}
+
+    void write(uint32_t value, int bits) {
+        m_buffer = (m_buffer << bits) | value;
+        m_bits += bits;
+        while (m_bits >= 8) {
+            m_bits -= 8;
+            m_out.push_back(static_cast<char>(m_buffer >> m_bits));
+        }
+    }
+
+    void flush() {
+        if (m_bits > 0) {
+            m_out.push_back(static_cast<char>(m_buffer << (8 - m_bits)));
+            m_bits = 0;
+        }
+    }
+
+private:
+    std::vector<char>& m_out;
+    uint64_t m_buffer;
+    int m_bits;
+};
+
+class BitReader {
+public:
+    BitReader(const char* data, size_t size)
+        : m_data(reinterpret_cast<const unsigned char*>(data)), m_size(size), m_pos(0), m_buffer(0), m_bits(0) {}
+
+    uint32_t read(int bits) {
+        while (m_bits < bits) {
+            if (m_pos == m_size) {
+                throw std::runtime_error("Unexpected end of BWT data.");
+            }
+            m_buffer = (m_buffer << 8) | m_data[m_pos++];
+            m_bits += 8;
+        }
+        m_bits -= bits;
+        return static_cast<uint32_t>(m_buffer >> m_bits) & ((1u << bits) - 1);
+    }
+
+private:
+    const unsigned char* m_data;
+    size_t m_size;
+    size_t m_pos;
+    uint64_t m_buffer;
+    int m_bits;
+};
+
+// Suffix array of s[0..n) by induced sorting (SA-IS), in linear time. A suffix that is a
+// prefix of another sorts first, as if the string ended in a sentinel below every symbol.
+template <typename Symbol>
+std::vector<int32_t> suffixArray(const Symbol* s, int32_t n, int32_t upper) {
+    if (n == 0) {
+        return {};
+    }
+    if (n == 1) {
+        return { 0 };
+    }
+    if (n == 2) {
+        return s[0] < s[1] ? std::vector<int32_t>{ 0, 1 } : std::vector<int32_t>{ 1, 0 };
+    }
+
+    // S-type suffixes are smaller than the suffix after them, L-type ones larger
+    std::vector<bool> sType(n);
+    for (int32_t i = n - 2; i >= 0; --i) {
+        sType[i] = s[i] == s[i + 1] ? sType[i + 1] : s[i] < s[i + 1];
+    }
+
+    // Each symbol's bucket holds its L-type suffixes from bucketStart, then its S-type ones from sStart
+    std::vector<int32_t> bucketStart(upper + 1), sStart(upper + 1);
+    for (int32_t i = 0; i < n; ++i) {
+        if (sType[i]) {
+            ++bucketStart[s[i] + 1];
+        } else {
+            ++sStart[s[i]];
+        }
+    }
+    for (int32_t c = 0; c <= upper; ++c) {
+        sStart[c] += bucketStart[c];
+        if (c < upper) {
+            bucketStart[c + 1] += sStart[c];
+        }
+    }
+
+    std::vector<int32_t> sa(n);
+    std::vector<int32_t> bucket(upper + 1);
+    auto induce = [&](const std::vector<int32_t>& lms) {
+        std::fill(sa.begin(), sa.end(), -1);
+        std::copy(sStart.begin(), sStart.end(), bucket.begin());
+        for (int32_t position : lms) {
+            sa[bucket[s[position]]++] = position;
+        }
+
+        std::copy(bucketStart.begin(), bucketStart.end(), bucket.begin());
+        sa[bucket[s[n - 1]]++] = n - 1;
+        for (int32_t i = 0; i < n; ++i) {
+            int32_t position = sa[i];
+            if (position >= 1 && !sType[position - 1]) {
+                sa[bucket[s[position - 1]]++] = position - 1;
+            }
+        }
+
+        std::copy(bucketStart.begin(), bucketStart.end(), bucket.begin());
+        for (int32_t i = n - 1; i >= 0; --i) {
+            int32_t position = sa[i];
+            if (position >= 1 && sType[position - 1]) {
+                sa[--bucket[s[position - 1] + 1]] = position - 1;
+            }
+        }
+    };
+
+    // Leftmost S-type positions, in text order
+    std::vector<int32_t> lmsIndex(n, -1);
+    std::vector<int32_t> lms;
+    for (int32_t i = 1; i < n; ++i) {
+        if (!sType[i - 1] && sType[i]) {
+            lmsIndex[i] = static_cast<int32_t>(lms.size());
+            lms.push_back(i);
+        }
+    }
+    int32_t m = static_cast<int32_t>(lms.size());
+
+    // Sort the LMS substrings, name them, and sort the suffixes of the string of names
+    induce(lms);
+    if (m > 0) {
+        std::vector<int32_t> sortedLms;
+        sortedLms.reserve(m);
+        for (int32_t position : sa) {
+            if (lmsIndex[position] != -1) {
+                sortedLms.push_back(position);
+            }
+        }
+
+        std::vector<int32_t> names(m);
+        int32_t name = 0;
+        names[lmsIndex[sortedLms[0]]] = 0;
+        for (int32_t i = 1; i < m; ++i) {
+            int32_t left = sortedLms[i - 1];
+            int32_t right = sortedLms[i];
+            int32_t leftEnd = lmsIndex[left] + 1 < m ? lms[lmsIndex[left] + 1] : n;
+            int32_t rightEnd = lmsIndex[right] + 1 < m ? lms[lmsIndex[right] + 1] : n;
+
+            bool same = leftEnd - left == rightEnd - right;
+            if (same) {
+                while (left < leftEnd && s[left] == s[right]) {
+                    ++left;
+                    ++right;
+                }
+                same = left != n && s[left] == s[right];
+            }
+            if (!same) {
+                ++name;
+            }
+            names[lmsIndex[sortedLms[i]]] = name;
+        }
+        std::vector<int32_t>().swap(lmsIndex);
+
+        std::vector<int32_t> namedSa = suffixArray(names.data(), m, name);
+        for (int32_t i = 0; i < m; ++i) {
+            sortedLms[i] = lms[namedSa[i]];
+        }
+        induce(sortedLms);
+    }
+    return sa;
+}
+
+// Huffman code lengths for every symbol, none longer than MAX_CODE_LENGTH. Unused
+// symbols get a code too, so a table is fully described by its lengths.
+void buildCodeLengths(const uint32_t* frequencies, uint8_t* lengths) {
+    using Node = std::pair<uint64_t, size_t>;
+
+    std::vector<uint64_t> weights(ALPHABET_SIZE);
+    for (size_t symbol = 0; symbol < ALPHABET_SIZE; ++symbol) {
+        weights[symbol] = std::max<uint64_t>(frequencies[symbol], 1);
+    }
+
+    std::vector<size_t> parent(2 * ALPHABET_SIZE - 1);
+    while (true) {
+        std::priority_queue<Node, std::vector<Node>, std::greater<Node>> heap;
+        for (size_t symbol = 0; symbol < ALPHABET_SIZE; ++symbol) {
+            heap.push({ weights[symbol], symbol });
+        }
+        size_t next = ALPHABET_SIZE;
+        while (heap.size() > 1) {
+            Node first = heap.top();
+            heap.pop();
+            Node second = heap.top();
+            heap.pop();
+            parent[first.second] = next;
+            parent[second.second] = next;
+            heap.push({ first.first + second.first, next++ });
+        }
+        size_t root = next - 1;
+
+        int longest = 0;
+        for (size_t symbol = 0; symbol < ALPHABET_SIZE; ++symbol) {
+            int depth = 0;
+            for (size_t node = symbol; node != root; node = parent[node]) {
+                ++depth;
+            }
+            lengths[symbol] = static_cast<uint8_t>(depth);
+            longest = std::max(longest, depth);
+        }
+        if (longest <= MAX_CODE_LENGTH) {
+            return;
+        }
+
+        // Flatten the distribution until the tree is shallow enough
+        for (auto& weight : weights) {
+            weight = 1 + weight / 2;
+        }
+    }
+}
+
+// Canonical codes: shorter codes first, and symbol order within a length
+void assignCodes(const uint8_t* lengths, uint32_t* codes) {
+    std::array<uint32_t, MAX_CODE_LENGTH + 1> counts{};
+    for (size_t symbol = 0; symbol < ALPHABET_SIZE; ++symbol) {
+        ++counts[lengths[symbol]];
+    }
+    std::array<uint32_t, MAX_CODE_LENGTH + 1> nextCode{};
+    uint32_t code = 0;
+    for (int length = 1; length <= MAX_CODE_LENGTH; ++length) {
+        code = (code + counts[length - 1]) << 1;
+        nextCode[length] = code;
+    }
+    for (size_t symbol = 0; symbol < ALPHABET_SIZE; ++symbol) {
+        codes[symbol] = nextCode[lengths[symbol]]++;
+    }
+}
+
+// Decodes a canonical code one bit at a time
+class HuffmanDecoder {
+public:
+    void build(const uint8_t* lengths) {
+        m_counts.fill(0);
+        for (size_t symbol = 0; symbol < ALPHABET_SIZE; ++symbol) {
+            ++m_counts[lengths[symbol]];
+        }
+        std::array<uint16_t, MAX_CODE_LENGTH + 2> offsets{};
+        for (int length = 1; length <= MAX_CODE_LENGTH; ++length) {
+            offsets[length + 1] = static_cast<uint16_t>(offsets[length] + m_counts[length]);
+        }
+        for (size_t symbol = 0; symbol < ALPHABET_SIZE; ++symbol) {
+            m_symbols[offsets[lengths[symbol]]++] = static_cast<uint16_t>(symbol);
+        }
+    }
+
+    uint16_t decode(BitReader& reader) const {
+        uint32_t code = 0;
+        uint32_t first = 0;
+        uint32_t index = 0;
+        for (int length = 1; length <= MAX_CODE_LENGTH; ++length) {
+            code |= reader.read(1);
+            uint32_t count = m_counts[length];
+            if (code - first < count) {
+                return m_symbols[index + code - first];
+            }
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+        }
+        throw std::runtime_error("Invalid Huffman code in BWT data.");
+    }
+
+private:
+    std::array<uint32_t, MAX_CODE_LENGTH + 1> m_counts{};
+    std::array<uint16_t, ALPHABET_SIZE> m_symbols{};
+};
+
+// Move-to-front the BWT and write zero runs as RUNA/RUNB digits
+void moveToFront(const std::vector<unsigned char>& last, std::vector<uint16_t>& symbols) {
+    std::array<unsigned char, 256> order;
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = static_cast<unsigned char>(i);
+    }
+
+    size_t run = 0;
+    auto flushRun = [&]() {
+        if (run == 0) {
+            return;
+        }
+        --run;
+        while (true) {
+            symbols.push_back((run & 1) ? RUNB : RUNA);
+            if (run < 2) {
+                break;
+            }
+            run = (run - 2) / 2;
+        }
+        run = 0;
+    };
+
+    for (unsigned char byte : last) {
+        if (order[0] == byte) {
+            ++run;
+            continue;
+        }
+        flushRun();
+
+        unsigned char previous = order[0];
+        order[0] = byte;
+        size_t position = 1;
+        while (order[position] != byte) {
+            std::swap(previous, order[position]);
+            ++position;
+        }
+        order[position] = previous;
+        symbols.push_back(static_cast<uint16_t>(position + 1));
+    }
+    flushRun();
+}
+
+// Choose a table per group and code lengths per table by a few rounds of refinement, as bzip2 does
+void chooseTables(const std::vector<uint16_t>& symbols, size_t tableCount, std::vector<uint8_t>& selectors,
+                  std::vector<std::array<uint8_t, ALPHABET_SIZE>>& lengths) {
+    size_t groupCount = (symbols.size() + GROUP_SIZE - 1) / GROUP_SIZE;
+    selectors.assign(groupCount, 0);
+    lengths.assign(tableCount, {});
+
+    // Start each table cheap on its own slice of the symbols, split by frequency
+    std::array<uint32_t, ALPHABET_SIZE> frequencies{};
+    for (uint16_t symbol : symbols) {
+        ++frequencies[symbol];
+    }
+    size_t remaining = symbols.size();
+    size_t symbol = 0;
+    for (size_t table = 0; table < tableCount; ++table) {
+        size_t tablesLeft = tableCount - table;
+        size_t target = remaining / tablesLeft;
+        size_t first = symbol;
+        size_t taken = 0;
+        while (symbol < ALPHABET_SIZE && (tablesLeft == 1 || taken < target || symbol == first)) {
+            taken += frequencies[symbol++];
+        }
+        remaining -= taken;
+        for (size_t v = 0; v < ALPHABET_SIZE; ++v) {
+            lengths[table][v] = v >= first && v < symbol ? 0 : 15;
+        }
+    }
+
+    std::vector<std::array<uint32_t, ALPHABET_SIZE>> tableFrequencies(tableCount);
+    for (int iteration = 0; iteration < TABLE_ITERATIONS; ++iteration) {
+        for (auto& counts : tableFrequencies) {
+            counts.fill(0);
+        }
+        for (size_t group = 0; group < groupCount; ++group) {
+            size_t start = group * GROUP_SIZE;
+            size_t end = std::min(start + GROUP_SIZE, symbols.size());
+
+            size_t best = 0;
+            uint32_t bestCost = UINT32_MAX;
+            for (size_t table = 0; table < tableCount; ++table) {
+                uint32_t cost = 0;
+                for (size_t i = start; i < end; ++i) {
+                    cost += lengths[table][symbols[i]];
+                }
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    best = table;
+                }
+            }
+            selectors[group] = static_cast<uint8_t>(best);
+            for (size_t i = start; i < end; ++i) {
+                ++tableFrequencies[best][symbols[i]];
+            }
+        }
+        for (size_t table = 0; table < tableCount; ++table) {
+            buildCodeLengths(tableFrequencies[table].data(), lengths[table].data());
+        }
+    }
+}
+
+} // namespace
+
+size_t bwtEncodeWorkspaceBytes(size_t size) {
+    // The suffix array and the induced sort's index of LMS positions dominate, with
+    // the recursion on at most half as many names adding up to as much again
+    return 20 * size;
+}
+
+size_t bwtDecodeWorkspaceBytes(size_t size) {
+    // The BWT itself and a 32-bit entry per row
+    return 5 * size + 4;
+}
+
+bool bwtCompress(const char* data, size_t size, std::vector<char>& payload, const CancellationToken* cancel) {
+    if (size == 0 || size > MAX_BWT_BLOCK_SIZE) {
+        return false;
+    }
+    throwIfCancelled(cancel);
+
+    // Rows are the block's suffixes in order, led by the empty one; the BWT is the byte
+    // before each, leaving out the row of the whole block, which is recorded instead
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    int32_t n = static_cast<int32_t>(size);
+    std::vector<unsigned char> last(size);
+    uint32_t primary = 0;
+    {
+        std::vector<int32_t> sa = suffixArray(bytes, n, 255);
+        last[0] = bytes[n - 1];
+        size_t out = 1;
+        for (int32_t i = 0; i < n; ++i) {
+            if (sa[i] == 0) {
+                primary = static_cast<uint32_t>(i + 1);
+            } else {
+                last[out++] = bytes[sa[i] - 1];
+            }
+        }
+    }
+    throwIfCancelled(cancel);
+
+    std::vector<uint16_t> symbols;
+    symbols.reserve(size);
+    moveToFront(last, symbols);
+
+    size_t tableCount = symbols.size() < 200 ? 2 : symbols.size() < 600 ? 3 : symbols.size() < 1200 ? 4
+                      : symbols.size() < 2400 ? 5 : MAX_TABLES;
+    std::vector<uint8_t> selectors;
+    std::vector<std::array<uint8_t, ALPHABET_SIZE>> lengths;
+    chooseTables(symbols, tableCount, selectors, lengths);
+
+    size_t start = payload.size();
+    writeLE32(payload, primary);
+    writeLE32(payload, static_cast<uint32_t>(symbols.size()));
+    payload.push_back(static_cast<char>(tableCount));
+
+    BitWriter writer(payload);
+    std::vector<std::array<uint32_t, ALPHABET_SIZE>> codes(tableCount);
+    for (size_t table = 0; table < tableCount; ++table) {
+        for (uint8_t length : lengths[table]) {
+            writer.write(length, CODE_LENGTH_BITS);
+        }
+        assignCodes(lengths[table].data(), codes[table].data());
+    }
+
+    std::array<uint8_t, MAX_TABLES> tableOrder;
+    for (size_t table = 0; table < MAX_TABLES; ++table) {
+        tableOrder[table] = static_cast<uint8_t>(table);
+    }
+    for (uint8_t selector : selectors) {
+        size_t position = 0;
+        while (tableOrder[position] != selector) {
+            ++position;
+        }
+        std::rotate(tableOrder.begin(), tableOrder.begin() + position, tableOrder.begin() + position + 1);
+        for (size_t i = 0; i < position; ++i) {
+            writer.write(1, 1);
+        }
+        writer.write(0, 1);
+    }
+
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        size_t table = selectors[i / GROUP_SIZE];
+        uint16_t symbol = symbols[i];
+        writer.write(codes[table][symbol], lengths[table][symbol]);
+    }
+    writer.flush();
+
+    if (payload.size() - start >= size) {
+        payload.resize(start);
+        return false;
+    }
+    return true;
+}
+
+void bwtDecompress(const char* payload, size_t payloadSize, char* out, size_t rawSize) {
+    if (payloadSize < BWT_HEADER_SIZE || rawSize == 0 || rawSize > MAX_BWT_BLOCK_SIZE) {
+        throw std::runtime_error("Invalid BWT block header.");
+    }
+    uint32_t primary = readLE32(payload);
+    uint32_t symbolCount = readLE32(payload + 4);
+    size_t tableCount = static_cast<unsigned char>(payload[8]);
+    if (primary == 0 || primary > rawSize || symbolCount > rawSize || tableCount < MIN_TABLES || tableCount > MAX_TABLES) {
+        throw std::runtime_error("Invalid BWT block header.");
+    }
+
+    BitReader reader(payload + BWT_HEADER_SIZE, payloadSize - BWT_HEADER_SIZE);
+    std::array<HuffmanDecoder, MAX_TABLES> decoders;
+    for (size_t table = 0; table < tableCount; ++table) {
+        std::array<uint8_t, ALPHABET_SIZE> lengths;
+        for (auto& length : lengths) {
+            length = static_cast<uint8_t>(reader.read(CODE_LENGTH_BITS));
+            if (length == 0 || length > MAX_CODE_LENGTH) {
+                throw std::runtime_error("Invalid Huffman table in BWT data.");
+            }
+        }
+        decoders[table].build(lengths.data());
+    }
+
+    size_t groupCount = (symbolCount + GROUP_SIZE - 1) / GROUP_SIZE;
+    std::vector<uint8_t> selectors(groupCount);
+    std::array<uint8_t, MAX_TABLES> tableOrder;
+    for (size_t table = 0; table < MAX_TABLES; ++table) {
+        tableOrder[table] = static_cast<uint8_t>(table);
+    }
+    for (auto& selector : selectors) {
+        size_t position = 0;
+        while (reader.read(1)) {
+            if (++position >= tableCount) {
+                throw std::runtime_error("Invalid table selector in BWT data.");
+            }
+        }
+        std::rotate(tableOrder.begin(), tableOrder.begin() + position, tableOrder.begin() + position + 1);
+        selector = tableOrder[0];
+    }
+
+    // Undo the Huffman coding, zero runs and move-to-front
+    std::vector<unsigned char> last(rawSize);
+    std::array<unsigned char, 256> order;
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = static_cast<unsigned char>(i);
+    }
+    size_t produced = 0;
+    uint64_t run = 0;
+    uint64_t runWeight = 1;
+    for (uint32_t i = 0; i < symbolCount; ++i) {
+        uint16_t symbol = decoders[selectors[i / GROUP_SIZE]].decode(reader);
+        if (symbol <= RUNB) {
+            run += (symbol + 1) * runWeight;
+            runWeight <<= 1;
+            if (run > rawSize - produced) {
+                throw std::runtime_error("Block size mismatch in BWT data.");
+            }
+            continue;
+        }
+        if (run > 0) {
+            std::memset(last.data() + produced, order[0], run);
+            produced += run;
+            run = 0;
+            runWeight = 1;
+        }
+
+        size_t position = symbol - 1;
+        unsigned char byte = order[position];
+        std::memmove(order.data() + 1, order.data(), position);
+        order[0] = byte;
+        if (produced == rawSize) {
+            throw std::runtime_error("Block size mismatch in BWT data.");
+        }
+        last[produced++] = byte;
+    }
+    std::memset(last.data() + produced, order[0], run);
+    produced += run;
+    if (produced != rawSize) {
+        throw std::runtime_error("Block size mismatch in BWT data.");
+    }
+
+    // Invert the BWT: next[row] is the row of the following suffix, with the byte that
+    // starts it in the top eight bits. Row primary, the whole block, has no byte before it.
+    std::array<uint32_t, 256> start{};
+    for (unsigned char byte : last) {
+        ++start[byte];
+    }
+    uint32_t total = 1;
+    for (auto& entry : start) {
+        uint32_t count = entry;
+        entry = total;
+        total += count;
+    }
+
+    std::vector<uint32_t> next(rawSize + 1);
+    next[0] = primary;
+    for (size_t i = 0; i < rawSize; ++i) {
+        uint32_t row = static_cast<uint32_t>(i < primary ? i : i + 1);
+        unsigned char byte = last[i];
+        next[start[byte]++] = row | (static_cast<uint32_t>(byte) << 24);
+    }
+
+    uint32_t row = primary;
+    for (size_t i = 0; i < rawSize; ++i) {
+        uint32_t entry = next[row];
+        row = entry & 0xFFFFFF;
+        out[i] = static_cast<char>(entry >> 24);
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef BWTCODEC_H
+#define BWTCODEC_H
+
+#include "JobProgress.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Burrows-Wheeler block codec for text: the block's BWT, built from an SA-IS suffix
+// array, goes through move-to-front, zero runs are written as RUNA/RUNB digits as in
+// bzip2, and the symbols are Huffman coded with up to six tables chosen per 50 symbols.
+//
+// Payload: the row of the whole block among its sorted suffixes (u32), the number
+// of coded symbols (u32) and the number of tables (u8), then a bit stream, most
+// significant bit first, of each table's code lengths (5 bits per symbol), the
+// move-to-front coded table selector of each group in unary, and the symbols.
+const size_t BWT_HEADER_SIZE = 9;
+
+// Scratch a thread needs besides the block and payload to encode, or decode, size bytes
+size_t bwtEncodeWorkspaceBytes(size_t size);
+size_t bwtDecodeWorkspaceBytes(size_t size);
+
+// Append the payload for data to payload. Returns false if it wouldn't be smaller
+// than the data. A triggered cancel token throws JobCancelled.
+bool bwtCompress(const char* data, size_t size, std::vector<char>& payload, const CancellationToken* cancel = nullptr);
+
+// Decode a payload into exactly rawSize bytes at out. Throws std::runtime_error if it is corrupt.
+void bwtDecompress(const char* payload, size_t payloadSize, char* out, size_t rawSize);
+
+#endif // BWTCODEC_H
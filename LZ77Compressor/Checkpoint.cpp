@@ -0,0 +1,88 @@
+#include "Checkpoint.h"
+#include "ArchiveFormat.h"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Checkpoint file header: magic and format version
+const char CHECKPOINT_MAGIC[6] = { 'M', 'Y', 'C', 'K', 'P', 'T' };
+const uint8_t CHECKPOINT_VERSION = 1;
+
+fs::path checkpointPath(const fs::path &outputPath) {
+    // Output directories are given with or without a trailing separator
+    fs::path path = fs::absolute(outputPath).lexically_normal();
+    if (path.filename().empty()) {
+        path = path.parent_path();
+    }
+    path += ".ckpt";
+    return path;
+}
+
+bool readCheckpoint(const fs::path &path, Checkpoint &checkpoint) {
+    std::ifstream infile(path, std::ios::binary);
+    if (!infile) {
+        return false;
+    }
+
+    char magic[sizeof(CHECKPOINT_MAGIC)];
+    infile.read(magic, sizeof(magic));
+    uint8_t version = 0;
+    infile.read(reinterpret_cast<char*>(&version), sizeof(version));
+    if (!infile || !std::equal(magic, magic + sizeof(magic), CHECKPOINT_MAGIC) || version != CHECKPOINT_VERSION) {
+        return false;
+    }
+
+    checkpoint.jobHash = readUInt64(infile);
+    checkpoint.offset = readUInt64(infile);
+    checkpoint.entries = readUInt64(infile);
+    checkpoint.blocks = readUInt32(infile);
+    checkpoint.prefixBytes = readUInt64(infile);
+    checkpoint.prefixHash = readUInt64(infile);
+    return static_cast<bool>(infile);
+}
+
+void writeCheckpoint(const fs::path &path, const Checkpoint &checkpoint) {
+    fs::path temporaryPath = path;
+    temporaryPath += ".tmp";
+    {
+        std::ofstream outfile(temporaryPath, std::ios::binary | std::ios::trunc);
+        outfile.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        outfile.write(reinterpret_cast<const char*>(&CHECKPOINT_VERSION), sizeof(CHECKPOINT_VERSION));
+        writeUInt64(outfile, checkpoint.jobHash);
+        writeUInt64(outfile, checkpoint.offset);
+        writeUInt64(outfile, checkpoint.entries);
+        writeUInt32(outfile, checkpoint.blocks);
+        writeUInt64(outfile, checkpoint.prefixBytes);
+        writeUInt64(outfile, checkpoint.prefixHash);
+        outfile.close();
+        if (!outfile) {
+            throw std::runtime_error("Failed to write checkpoint: " + temporaryPath.string());
+        }
+    }
+    fs::rename(temporaryPath, path);
+}
+
+void removeCheckpoint(const fs::path &path) {
+    std::error_code ec;
+    fs::remove(path, ec);
+}
+
+uint64_t hashFileRange(const fs::path &path, uint64_t offset, uint64_t length, uint64_t hash) {
+    std::ifstream infile(path, std::ios::binary);
+    infile.seekg(static_cast<std::streamoff>(offset));
+
+    std::vector<char> buffer(1024 * 1024);
+    while (length > 0) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(buffer.size(), length));
+        infile.read(buffer.data(), chunk);
+        if (!infile) {
+            throw std::runtime_error("Failed to read back " + path.string());
+        }
+        hash = hashData(buffer.data(), chunk, hash);
+        length -= chunk;
+    }
+    return hash;
+}
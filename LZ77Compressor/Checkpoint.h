@@ -0,0 +1,38 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// Jobs record how far they got at most this often, and once more when they fail or are cancelled
+const std::chrono::seconds CHECKPOINT_INTERVAL(5);
+
+// Progress of an interrupted job, kept in a small file next to its output. Running
+// the same job again picks up from here once the recorded prefix checks out.
+struct Checkpoint {
+    uint64_t jobHash = 0;          // Fingerprint of the job's inputs and options
+    uint64_t offset = 0;           // Archive offset everything before which is complete
+    uint64_t entries = 0;          // Entries before offset
+    uint32_t blocks = 0;           // Blocks completed of the entry at offset
+    uint64_t prefixBytes = 0;      // Bytes covered by prefixHash
+    uint64_t prefixHash = 0;       // Hash of the completed output the resume is checked against
+};
+
+// Where the checkpoint of a job writing to outputPath is kept
+std::filesystem::path checkpointPath(const std::filesystem::path &outputPath);
+
+// Returns false if there is no readable checkpoint at path
+bool readCheckpoint(const std::filesystem::path &path, Checkpoint &checkpoint);
+
+// Replaces the checkpoint at path in a single rename, so a crash leaves the old or the new one
+void writeCheckpoint(const std::filesystem::path &path, const Checkpoint &checkpoint);
+
+void removeCheckpoint(const std::filesystem::path &path);
+
+// Continue an FNV-1a hash over length bytes of a file from offset. Throws std::runtime_error
+// if the file is shorter.
+uint64_t hashFileRange(const std::filesystem::path &path, uint64_t offset, uint64_t length, uint64_t hash);
+
+#endif // CHECKPOINT_H
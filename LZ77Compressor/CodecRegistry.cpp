@@ -0,0 +1,174 @@
+#include "CodecRegistry.h"
+#include "BwtCodec.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Sliding-window tokens, 5 bytes each, as blocks were written before repeat-offset tokens
+class FixedTokenCodec : public Codec {
+public:
+    BlockCodec id() const override { return BlockCodec::LZ77; }
+    const char* name() const override { return "lz77-fixed"; }
+    size_t bound(size_t size) const override { return size; }
+
+    // Tokens, of which a block that isn't stored has fewer than size / TOKEN_SIZE
+    size_t encodeWorkspaceBytes(size_t size) const override { return size; }
+    size_t decodeWorkspaceBytes(size_t) const override { return 0; }
+
+    bool compress(const char* data, size_t size, const LZ77Settings& settings,
+                  CodecWorkspace& workspace, std::vector<char>& payload) const override {
+        // A block with more tokens than size / TOKEN_SIZE is stored, so the match finder stops
+        // there and the token buffer only grows for a larger block than it has seen
+        workspace.tokens.reserve(size / TOKEN_SIZE);
+        bool complete;
+        {
+            StageTimer timer(workspace.times.matchFindingNanoseconds);
+            complete = compressData(data, size, workspace.tokens, settings, workspace.cancel, size / TOKEN_SIZE);
+        }
+        if (!complete || workspace.tokens.size() * TOKEN_SIZE >= size) {
+            return false;
+        }
+
+        StageTimer timer(workspace.times.encodingNanoseconds);
+        workspace.tokenCount = workspace.tokens.size();
+        for (const auto& token : workspace.tokens) {
+            workspace.tokenStats.add(token.offset, token.length);
+        }
+        serializeTokens(workspace.tokens, payload);
+        return true;
+    }
+
+    void decompress(const char* payload, size_t payloadSize, char* out, size_t rawSize,
+                    TokenStats* tokenStats) const override {
+        decodeTokens(payload, payloadSize, out, rawSize, tokenStats);
+    }
+
+    // Every token restores at least one byte and at most a full-length match and its literal
+    bool validSizes(size_t payloadSize, size_t rawSize) const override {
+        size_t tokens = payloadSize / TOKEN_SIZE;
+        return payloadSize > 0 && payloadSize % TOKEN_SIZE == 0 && tokens <= rawSize &&
+               rawSize <= static_cast<uint64_t>(tokens) * (UINT16_MAX + 1);
+    }
+};
+
+// Sliding-window tokens coded against the last few match offsets
+class RepeatTokenCodec : public Codec {
+public:
+    BlockCodec id() const override { return BlockCodec::LZ77Repeat; }
+    const char* name() const override { return "lz77"; }
+    size_t bound(size_t size) const override { return size; }
+
+    // Tokens, of which a block that isn't stored has fewer than size / MIN_REPEAT_TOKEN_SIZE
+    size_t encodeWorkspaceBytes(size_t size) const override { return size / MIN_REPEAT_TOKEN_SIZE * sizeof(Token); }
+    size_t decodeWorkspaceBytes(size_t) const override { return 0; }
+
+    bool compress(const char* data, size_t size, const LZ77Settings& settings,
+                  CodecWorkspace& workspace, std::vector<char>& payload) const override {
+        workspace.tokens.reserve(size / MIN_REPEAT_TOKEN_SIZE);
+        bool complete;
+        {
+            StageTimer timer(workspace.times.matchFindingNanoseconds);
+            complete = compressData(data, size, workspace.tokens, settings, workspace.cancel,
+                                    size / MIN_REPEAT_TOKEN_SIZE);
+        }
+        if (!complete) {
+            return false;
+        }
+
+        // Statistics go in only once the block is known to shrink
+        StageTimer timer(workspace.times.encodingNanoseconds);
+        TokenStats tokenStats;
+        size_t start = payload.size();
+        serializeRepeatTokens(workspace.tokens, size, payload, &tokenStats);
+        if (payload.size() - start >= size) {
+            return false;
+        }
+        workspace.tokenCount = workspace.tokens.size();
+        workspace.tokenStats.merge(tokenStats);
+        return true;
+    }
+
+    void decompress(const char* payload, size_t payloadSize, char* out, size_t rawSize,
+                    TokenStats* tokenStats) const override {
+        decodeRepeatTokens(payload, payloadSize, out, rawSize, tokenStats);
+    }
+
+    bool validSizes(size_t payloadSize, size_t rawSize) const override {
+        return payloadSize > 0 && payloadSize < rawSize;
+    }
+};
+
+// The block's bytes as they are; chosen for blocks no other codec shrinks
+class StoredCodec : public Codec {
+public:
+    BlockCodec id() const override { return BlockCodec::Stored; }
+    const char* name() const override { return "stored"; }
+    size_t bound(size_t size) const override { return size; }
+    size_t encodeWorkspaceBytes(size_t) const override { return 0; }
+    size_t decodeWorkspaceBytes(size_t) const override { return 0; }
+
+    bool compress(const char*, size_t, const LZ77Settings&, CodecWorkspace&, std::vector<char>&) const override {
+        return false;
+    }
+
+    void decompress(const char* payload, size_t payloadSize, char* out, size_t rawSize, TokenStats*) const override {
+        if (payloadSize != rawSize) {
+            throw std::runtime_error("Block size mismatch in stored data.");
+        }
+        std::memcpy(out, payload, rawSize);
+    }
+
+    bool validSizes(size_t payloadSize, size_t rawSize) const override {
+        return payloadSize == rawSize;
+    }
+};
+
+// Burrows-Wheeler transform with move-to-front and Huffman coding; slower than LZ77
+// on both ends but smaller on text
+class BwtBlockCodec : public Codec {
+public:
+    BlockCodec id() const override { return BlockCodec::BWT; }
+    const char* name() const override { return "bwt"; }
+    size_t bound(size_t size) const override { return size; }
+    size_t encodeWorkspaceBytes(size_t size) const override { return bwtEncodeWorkspaceBytes(size); }
+    size_t decodeWorkspaceBytes(size_t size) const override { return bwtDecodeWorkspaceBytes(size); }
+
+    bool compress(const char* data, size_t size, const LZ77Settings&, CodecWorkspace& workspace,
+                  std::vector<char>& payload) const override {
+        StageTimer timer(workspace.times.encodingNanoseconds);
+        return bwtCompress(data, size, payload, workspace.cancel);
+    }
+
+    void decompress(const char* payload, size_t payloadSize, char* out, size_t rawSize, TokenStats*) const override {
+        bwtDecompress(payload, payloadSize, out, rawSize);
+    }
+
+    bool validSizes(size_t payloadSize, size_t rawSize) const override {
+        return payloadSize >= BWT_HEADER_SIZE && payloadSize < rawSize;
+    }
+};
+
+const FixedTokenCodec fixedTokenCodec;
+const RepeatTokenCodec lz77Codec;
+const StoredCodec storedCodec;
+const BwtBlockCodec bwtCodec;
+
+} // namespace
+
+const std::vector<const Codec*>& registeredCodecs() {
+    static const std::vector<const Codec*> codecs = { &fixedTokenCodec, &storedCodec, &bwtCodec, &lz77Codec };
+    return codecs;
+}
+
+const Codec* findCodec(BlockCodec id) {
+    const auto& codecs = registeredCodecs();
+    auto it = std::find_if(codecs.begin(), codecs.end(), [id](const Codec* codec) { return codec->id() == id; });
+    return it != codecs.end() ? *it : nullptr;
+}
+
+const Codec* findCodec(const std::string& name) {
+    const auto& codecs = registeredCodecs();
+    auto it = std::find_if(codecs.begin(), codecs.end(), [&name](const Codec* codec) { return name == codec->name(); });
+    return it != codecs.end() ? *it : nullptr;
+}
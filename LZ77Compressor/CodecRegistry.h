@@ -0,0 +1,64 @@
+#ifndef CODECREGISTRY_H
+#define CODECREGISTRY_H
+
+#include "ArchiveFormat.h"
+#include "JobProgress.h"
+#include "JobStats.h"
+#include "LZ77Codec.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Scratch space and statistics a thread keeps for the codecs it runs, reused from block to block
+struct CodecWorkspace {
+    std::vector<Token> tokens;
+    TokenStats tokenStats;
+    StageTimes times;
+    uint64_t tokenCount = 0;      // Tokens in the last payload, for codecs that produce them
+    const CancellationToken* cancel = nullptr;
+
+    // A block after its entry's filters, and the filters' own scratch
+    std::vector<char> filtered;
+    std::vector<char> filterScratch;
+};
+
+// A block encoding, identified in block headers by its id. Codecs are stateless and
+// shared by every thread; whatever they need between calls lives in the workspace.
+class Codec {
+public:
+    virtual ~Codec() = default;
+
+    virtual BlockCodec id() const = 0;
+    virtual const char* name() const = 0;
+
+    // Largest payload compress() writes for size bytes
+    virtual size_t bound(size_t size) const = 0;
+
+    // Scratch memory a thread needs to encode, or decode, a block of size bytes besides
+    // the block and its payload
+    virtual size_t encodeWorkspaceBytes(size_t size) const = 0;
+    virtual size_t decodeWorkspaceBytes(size_t size) const = 0;
+
+    // Append the payload for data to payload. Returns false, leaving payload unspecified,
+    // if it wouldn't be smaller than the data; the block is then stored. Settings are the
+    // match finder's, and codecs without one ignore them.
+    virtual bool compress(const char* data, size_t size, const LZ77Settings& settings,
+                          CodecWorkspace& workspace, std::vector<char>& payload) const = 0;
+
+    // Decode a payload into exactly rawSize bytes at out. Throws std::runtime_error if it is corrupt.
+    virtual void decompress(const char* payload, size_t payloadSize, char* out, size_t rawSize,
+                            TokenStats* tokenStats) const = 0;
+
+    // Whether a block header's sizes are possible for this codec, checked before reading the payload
+    virtual bool validSizes(size_t payloadSize, size_t rawSize) const = 0;
+};
+
+// Every codec blocks can be written with, in id order. Duplicate blocks reference
+// another block's payload and have no codec of their own.
+const std::vector<const Codec*>& registeredCodecs();
+
+// nullptr if no codec has this id or name
+const Codec* findCodec(BlockCodec id);
+const Codec* findCodec(const std::string& name);
+
+#endif // CODECREGISTRY_H
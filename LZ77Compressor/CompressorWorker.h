@@ -1,6 +1,7 @@
 #ifndef COMPRESSORWORKER_H
 #define COMPRESSORWORKER_H
 
+#include "JobProgress.h"
 #include <QObject>
 #include <QString>
 
@@ -9,17 +10,33 @@ class CompressorWorker : public QObject {
 public:
     explicit CompressorWorker(const QString& inputPath, const QString& outputFile, QObject* parent = nullptr);
 
+    // Build the output as an update of an existing archive: entries whose size and
+    // modification time (and optionally content hash) are unchanged are copied verbatim
+    void setBaseArchive(const QString& archiveFile, bool compareHashes = false);
+
+    // Also write the job's statistics report to this file as JSON
+    void setReportFile(const QString& reportFile);
+
 public slots:
     void process();
 
+    // Ask a running job to stop; safe to call from any thread. The job then emits
+    // error() with the cancellation message instead of finished().
+    void cancel();
+
 signals:
     void finished();
     void error(const QString& message);
     void progress(int percentage);
+    void statsReady(const QString& json);
 
 private:
     QString m_inputPath;
     QString m_outputFile;
+    QString m_baseArchive;
+    QString m_reportFile;
+    CancellationToken m_cancel;
+    bool m_compareHashes;
 };
 
 #endif // COMPRESSORWORKER_H
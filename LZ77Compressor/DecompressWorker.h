@@ -1,6 +1,7 @@
 #ifndef DECOMPRESSWORKER_H
 #define DECOMPRESSWORKER_H
 
+#include "JobProgress.h"
 #include <QObject>
 #include <QString>
 
@@ -9,17 +10,27 @@ class DecompressWorker : public QObject {
 public:
     explicit DecompressWorker(const QString &inputFile, const QString &outputPath, QObject *parent = nullptr);
 
+    // Also write the job's statistics report to this file as JSON
+    void setReportFile(const QString &reportFile);
+
 public slots:
     void process();
 
+    // Ask a running job to stop; safe to call from any thread. The job then emits
+    // error() with the cancellation message instead of finished().
+    void cancel();
+
 signals:
     void finished();
     void error(const QString &message);
     void progress(int percentage);
+    void statsReady(const QString &json);
 
 private:
     QString m_inputFile;
     QString m_outputPath;
+    QString m_reportFile;
+    CancellationToken m_cancel;
 };
 
 #endif // DECOMPRESSWORKER_H
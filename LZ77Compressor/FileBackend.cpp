@@ -0,0 +1,55 @@
+#include "FileBackend.h"
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#ifdef LZ77_IO_URING
+#include "IoUringFileBackend.h"
+#endif
+
+void StreamFileBackend::readFiles(std::vector<FileRequest>& requests) {
+    for (auto& request : requests) {
+        std::ifstream infile(request.path, std::ios::binary);
+        if (!infile) {
+            throw std::runtime_error("Failed to open input file: " + request.path.string());
+        }
+
+        // Read straight into the caller's buffer; one byte past the expected size
+        // tells whether the file grew, in which case the rest is appended
+        request.data.resize(request.expectedSize + 1);
+        infile.read(request.data.data(), request.data.size());
+        request.data.resize(static_cast<size_t>(infile.gcount()));
+        if (request.data.size() > request.expectedSize) {
+            request.data.insert(request.data.end(), std::istreambuf_iterator<char>(infile),
+                                std::istreambuf_iterator<char>());
+        }
+    }
+}
+
+void StreamFileBackend::writeFiles(std::vector<FileRequest>& requests) {
+    for (auto& request : requests) {
+        std::ofstream outfile(request.path, std::ios::binary);
+        if (!outfile) {
+            throw std::runtime_error("Failed to create output file: " + request.path.string());
+        }
+
+        outfile.write(request.data.data(), request.data.size());
+        outfile.close();
+        if (!outfile) {
+            throw std::runtime_error("Failed to write output file: " + request.path.string());
+        }
+    }
+}
+
+std::unique_ptr<FileBackend> createFileBackend(bool allowAsync) {
+#ifdef LZ77_IO_URING
+    if (allowAsync) {
+        if (auto backend = IoUringFileBackend::create()) {
+            return backend;
+        }
+    }
+#else
+    (void)allowAsync;
+#endif
+    return std::make_unique<StreamFileBackend>();
+}
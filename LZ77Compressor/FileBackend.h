@@ -0,0 +1,44 @@
+#ifndef FILEBACKEND_H
+#define FILEBACKEND_H
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+// One whole-file transfer handled by a FileBackend
+struct FileRequest {
+    std::filesystem::path path;
+    std::vector<char> data;   // Filled by reads, written out by writes
+    size_t expectedSize = 0;  // Size measured before a read
+};
+
+// Whole-file reads and writes used by the workers. Requests are handed over in
+// batches so that backends can overlap the opens, transfers and closes of many
+// small files instead of paying a round of syscalls per file.
+class FileBackend {
+public:
+    virtual ~FileBackend() = default;
+
+    // Read each file completely into its request's data
+    virtual void readFiles(std::vector<FileRequest>& requests) = 0;
+
+    // Create or truncate each file and write its request's data
+    virtual void writeFiles(std::vector<FileRequest>& requests) = 0;
+
+    virtual const char* name() const = 0;
+};
+
+// Portable backend built on std::ifstream/std::ofstream
+class StreamFileBackend : public FileBackend {
+public:
+    void readFiles(std::vector<FileRequest>& requests) override;
+    void writeFiles(std::vector<FileRequest>& requests) override;
+    const char* name() const override { return "fstream"; }
+};
+
+// Returns the io_uring backend when it was built in and the kernel supports it,
+// otherwise the fstream backend
+std::unique_ptr<FileBackend> createFileBackend(bool allowAsync = true);
+
+#endif // FILEBACKEND_H
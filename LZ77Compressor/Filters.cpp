@@ -0,0 +1,219 @@
+#include "Filters.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// Delta filters work backwards when encoding so every byte is taken against the original
+void encodeDelta(char* data, size_t size, size_t distance) {
+    for (size_t i = size; i-- > distance;) {
+        data[i] = static_cast<char>(data[i] - data[i - distance]);
+    }
+}
+
+void decodeDelta(char* data, size_t size, size_t distance) {
+    for (size_t i = distance; i < size; ++i) {
+        data[i] = static_cast<char>(data[i] + data[i - distance]);
+    }
+}
+
+// E8 (CALL) and E9 (JMP) are followed by a 32-bit displacement from the next instruction.
+// Near ones, whose top byte is 00 or FF, get their low 24 bits turned into the target's
+// position in the block, so calls to one function repeat. The opcode and the top byte
+// are left alone, and an opcode whose top byte fails the check keeps the next three bytes
+// from being converted, as their operands would overwrite that byte. Every check then
+// reads bytes the decoder sees unchanged, so it finds exactly the operands the encoder changed.
+void transformX86(char* data, size_t size, bool encode) {
+    unsigned char* bytes = reinterpret_cast<unsigned char*>(data);
+    size_t blockedUntil = 0;
+    for (size_t i = 0; i + 5 <= size;) {
+        if ((bytes[i] != 0xE8 && bytes[i] != 0xE9) || i < blockedUntil) {
+            ++i;
+            continue;
+        }
+        if (bytes[i + 4] != 0x00 && bytes[i + 4] != 0xFF) {
+            blockedUntil = i + 4;
+            ++i;
+            continue;
+        }
+
+        uint32_t value = static_cast<uint32_t>(bytes[i + 1]) |
+                         (static_cast<uint32_t>(bytes[i + 2]) << 8) |
+                         (static_cast<uint32_t>(bytes[i + 3]) << 16);
+        uint32_t position = static_cast<uint32_t>(i + 5);
+        value = encode ? value + position : value - position;
+        bytes[i + 1] = static_cast<unsigned char>(value);
+        bytes[i + 2] = static_cast<unsigned char>(value >> 8);
+        bytes[i + 3] = static_cast<unsigned char>(value >> 16);
+        i += 5;
+    }
+}
+
+// Records become columns: byte c of every record, then byte c + 1, and so on.
+// A partial record at the end stays where it is.
+void transposeRecords(std::vector<char>& data, std::vector<char>& scratch, size_t recordSize, bool encode) {
+    size_t records = data.size() / recordSize;
+    if (records < 2) {
+        return;
+    }
+
+    scratch.resize(data.size());
+    const char* in = data.data();
+    char* out = scratch.data();
+    for (size_t column = 0; column < recordSize; ++column) {
+        for (size_t record = 0; record < records; ++record) {
+            size_t rowIndex = record * recordSize + column;
+            size_t columnIndex = column * records + record;
+            if (encode) {
+                out[columnIndex] = in[rowIndex];
+            } else {
+                out[rowIndex] = in[columnIndex];
+            }
+        }
+    }
+    size_t tail = records * recordSize;
+    std::copy(data.begin() + tail, data.end(), scratch.begin() + tail);
+    data.swap(scratch);
+}
+
+bool validFilter(const Filter& filter) {
+    switch (filter.type) {
+    case FilterType::Delta:
+        return filter.parameter >= 1 && filter.parameter <= MAX_DELTA_DISTANCE;
+    case FilterType::X86:
+        return filter.parameter == 0;
+    case FilterType::Records:
+        return filter.parameter >= 2 && filter.parameter <= MAX_RECORD_SIZE;
+    }
+    return false;
+}
+
+} // namespace
+
+Filter parseFilter(const std::string& text) {
+    size_t colon = text.find(':');
+    std::string name = text.substr(0, colon);
+
+    Filter filter;
+    if (name == "delta") {
+        filter.type = FilterType::Delta;
+        filter.parameter = 1;
+    } else if (name == "x86") {
+        filter.type = FilterType::X86;
+        filter.parameter = 0;
+    } else if (name == "records") {
+        filter.type = FilterType::Records;
+        filter.parameter = 0;
+    } else {
+        throw std::runtime_error("Unknown filter: " + text);
+    }
+
+    if (colon != std::string::npos) {
+        std::string value = text.substr(colon + 1);
+        if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos || value.size() > 9) {
+            throw std::runtime_error("Invalid filter parameter: " + text);
+        }
+        filter.parameter = static_cast<uint32_t>(std::stoul(value));
+    }
+    if (!validFilter(filter)) {
+        throw std::runtime_error("Invalid filter parameter: " + text);
+    }
+    return filter;
+}
+
+std::string filterChainName(const FilterChain& filters) {
+    std::string name;
+    for (const auto& filter : filters) {
+        if (!name.empty()) {
+            name += ',';
+        }
+        switch (filter.type) {
+        case FilterType::Delta:
+            name += "delta:" + std::to_string(filter.parameter);
+            break;
+        case FilterType::X86:
+            name += "x86";
+            break;
+        case FilterType::Records:
+            name += "records:" + std::to_string(filter.parameter);
+            break;
+        }
+    }
+    return name;
+}
+
+bool validFilterChain(const FilterChain& filters) {
+    if (filters.size() > MAX_FILTERS) {
+        return false;
+    }
+    for (const auto& filter : filters) {
+        if (!validFilter(filter)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void writeFilterChain(std::ostream& stream, const FilterChain& filters) {
+    writeVarUInt(stream, filters.size());
+    for (const auto& filter : filters) {
+        stream.put(static_cast<char>(filter.type));
+        writeVarUInt(stream, filter.parameter);
+    }
+}
+
+FilterChain readFilterChain(std::istream& stream) {
+    FilterChain filters;
+    uint64_t count = readVarUInt(stream);
+    if (count > MAX_FILTERS) {
+        stream.setstate(std::ios::failbit);
+        return filters;
+    }
+
+    for (uint64_t index = 0; index < count && stream; ++index) {
+        Filter filter;
+        filter.type = static_cast<FilterType>(stream.get());
+        uint64_t parameter = readVarUInt(stream);
+        filter.parameter = static_cast<uint32_t>(parameter);
+        if (parameter > UINT32_MAX || !validFilter(filter)) {
+            stream.setstate(std::ios::failbit);
+            return filters;
+        }
+        filters.push_back(filter);
+    }
+    return filters;
+}
+
+void applyFilters(const FilterChain& filters, const char* data, size_t size, std::vector<char>& out,
+                  std::vector<char>& scratch) {
+    out.assign(data, data + size);
+    for (const auto& filter : filters) {
+        switch (filter.type) {
+        case FilterType::Delta:
+            encodeDelta(out.data(), out.size(), filter.parameter);
+            break;
+        case FilterType::X86:
+            transformX86(out.data(), out.size(), true);
+            break;
+        case FilterType::Records:
+            transposeRecords(out, scratch, filter.parameter, true);
+            break;
+        }
+    }
+}
+
+void reverseFilters(const FilterChain& filters, std::vector<char>& data, std::vector<char>& scratch) {
+    for (auto it = filters.rbegin(); it != filters.rend(); ++it) {
+        switch (it->type) {
+        case FilterType::Delta:
+            decodeDelta(data.data(), data.size(), it->parameter);
+            break;
+        case FilterType::X86:
+            transformX86(data.data(), data.size(), false);
+            break;
+        case FilterType::Records:
+            transposeRecords(data, scratch, it->parameter, false);
+            break;
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef FILTERS_H
+#define FILTERS_H
+
+#include "ArchiveFormat.h"
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// A reversible transform run over a block before its codec, so that data whose
+// repeats hide behind changing numbers turns into repeats the match finder sees:
+//   delta:N    each byte minus the byte N before it; N = 1 for bytes, 2 or 4 for
+//              little-endian words and samples, or a row length for images
+//   x86        relative CALL/JMP targets in x86 code turned into block positions
+//   records:N  fixed-size records of N bytes transposed into columns
+struct Filter {
+    FilterType type = FilterType::Delta;
+    uint32_t parameter = 1;
+};
+
+// Filters in the order they are applied; the decoder undoes them in reverse
+using FilterChain = std::vector<Filter>;
+
+// Longest chain an entry may carry, and the bounds of each filter's parameter
+const size_t MAX_FILTERS = 4;
+const uint32_t MAX_DELTA_DISTANCE = 256;
+const uint32_t MAX_RECORD_SIZE = 65535;
+
+// Parse a filter as written on the command line, such as delta:2, x86 or records:12.
+// Throws std::runtime_error for an unknown filter or an out-of-range parameter.
+Filter parseFilter(const std::string& text);
+
+// The chain in parseFilter() notation, comma-separated; empty for no filters
+std::string filterChainName(const FilterChain& filters);
+
+bool validFilterChain(const FilterChain& filters);
+
+// Entry header form: a varint count, then each filter's type byte and varint parameter.
+// Reading an invalid chain fails the stream.
+void writeFilterChain(std::ostream& stream, const FilterChain& filters);
+FilterChain readFilterChain(std::istream& stream);
+
+// Filter size bytes of data into out. Both out and scratch are reused from block to block.
+void applyFilters(const FilterChain& filters, const char* data, size_t size, std::vector<char>& out,
+                  std::vector<char>& scratch);
+
+// Undo applyFilters() on a decoded block in place
+void reverseFilters(const FilterChain& filters, std::vector<char>& data, std::vector<char>& scratch);
+
+#endif // FILTERS_H
@@ -0,0 +1,281 @@
+#include "IoUringFileBackend.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+std::unique_ptr<FileBackend> IoUringFileBackend::create(unsigned queueDepth) {
+    std::unique_ptr<IoUringFileBackend> backend(new IoUringFileBackend());
+    if (!backend->setup(queueDepth)) {
+        return nullptr;
+    }
+    return backend;
+}
+
+IoUringFileBackend::~IoUringFileBackend() {
+    if (m_sqes) {
+        munmap(m_sqes, m_sqesSize);
+    }
+    if (m_cqRing && m_cqRing != m_sqRing) {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+    if (m_sqRing) {
+        munmap(m_sqRing, m_sqRingSize);
+    }
+    if (m_ringFd >= 0) {
+        close(m_ringFd);
+    }
+}
+
+bool IoUringFileBackend::setup(unsigned queueDepth) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    m_ringFd = static_cast<int>(syscall(__NR_io_uring_setup, queueDepth, &params));
+    if (m_ringFd < 0) {
+        return false;
+    }
+
+    // Make sure every opcode used by the batches is available
+    std::vector<char> probeBuffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probeBuffer.data());
+    if (syscall(__NR_io_uring_register, m_ringFd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        return false;
+    }
+    for (int opcode : { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE }) {
+        if (opcode > probe->last_op || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED)) {
+            return false;
+        }
+    }
+
+    // Map the submission and completion rings and the submission entries
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMap) {
+        m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+    }
+
+    void* sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        m_ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        return false;
+    }
+    m_sqRing = sqRing;
+
+    if (singleMap) {
+        m_cqRing = m_sqRing;
+    } else {
+        void* cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            m_ringFd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            return false;
+        }
+        m_cqRing = cqRing;
+    }
+
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      m_ringFd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return false;
+    }
+    m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(m_sqRing);
+    m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    m_sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    m_sqEntries = params.sq_entries;
+
+    char* cq = static_cast<char*>(m_cqRing);
+    m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    m_cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+void IoUringFileBackend::run(const std::vector<size_t>& indices,
+                             const std::function<void(io_uring_sqe&, size_t)>& prepare,
+                             std::vector<int>& results) {
+    size_t submitted = 0;
+    size_t completed = 0;
+
+    while (completed < indices.size()) {
+        // Fill the submission queue
+        unsigned toSubmit = 0;
+        unsigned tail = *m_sqTail;
+        while (submitted < indices.size() && submitted - completed < m_sqEntries) {
+            unsigned slot = tail & *m_sqMask;
+            io_uring_sqe& sqe = m_sqes[slot];
+            std::memset(&sqe, 0, sizeof(sqe));
+            prepare(sqe, indices[submitted]);
+            sqe.user_data = indices[submitted];
+            m_sqArray[slot] = slot;
+            ++tail;
+            ++toSubmit;
+            ++submitted;
+        }
+        __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+
+        // Submit and wait for at least one completion
+        int entered = static_cast<int>(syscall(__NR_io_uring_enter, m_ringFd, toSubmit, 1,
+                                               IORING_ENTER_GETEVENTS, nullptr, 0));
+        if (entered < 0 && errno != EINTR) {
+            throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+        }
+
+        // Reap completions
+        unsigned head = *m_cqHead;
+        unsigned cqTail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+        while (head != cqTail) {
+            const io_uring_cqe& cqe = m_cqes[head & *m_cqMask];
+            results[static_cast<size_t>(cqe.user_data)] = cqe.res;
+            ++head;
+            ++completed;
+        }
+        __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+    }
+}
+
+std::vector<int> IoUringFileBackend::openFiles(std::vector<FileRequest>& requests, int flags) {
+    std::vector<size_t> indices(requests.size());
+    for (size_t i = 0; i < indices.size(); ++i) {
+        indices[i] = i;
+    }
+
+    std::vector<int> fds(requests.size(), -1);
+    run(indices, [&](io_uring_sqe& sqe, size_t index) {
+        sqe.opcode = IORING_OP_OPENAT;
+        sqe.fd = AT_FDCWD;
+        sqe.addr = reinterpret_cast<uint64_t>(requests[index].path.c_str());
+        sqe.len = 0666;
+        sqe.open_flags = static_cast<uint32_t>(flags | O_CLOEXEC);
+    }, fds);
+
+    return fds;
+}
+
+void IoUringFileBackend::closeFiles(const std::vector<int>& fds) {
+    std::vector<size_t> indices;
+    for (size_t i = 0; i < fds.size(); ++i) {
+        if (fds[i] >= 0) {
+            indices.push_back(i);
+        }
+    }
+
+    std::vector<int> results(fds.size(), 0);
+    run(indices, [&](io_uring_sqe& sqe, size_t index) {
+        sqe.opcode = IORING_OP_CLOSE;
+        sqe.fd = fds[index];
+    }, results);
+}
+
+void IoUringFileBackend::readFiles(std::vector<FileRequest>& requests) {
+    std::vector<int> fds = openFiles(requests, O_RDONLY);
+    for (size_t i = 0; i < requests.size(); ++i) {
+        if (fds[i] < 0) {
+            closeFiles(fds);
+            throw std::runtime_error("Failed to open input file: " + requests[i].path.string());
+        }
+    }
+
+    // Ask for one byte more than expected so a short read marks the end of file;
+    // files that grew get a bigger buffer and another round
+    std::vector<size_t> filled(requests.size(), 0);
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < requests.size(); ++i) {
+        requests[i].data.resize(requests[i].expectedSize + 1);
+        pending.push_back(i);
+    }
+
+    std::vector<int> results(requests.size(), 0);
+    while (!pending.empty()) {
+        run(pending, [&](io_uring_sqe& sqe, size_t index) {
+            sqe.opcode = IORING_OP_READ;
+            sqe.fd = fds[index];
+            sqe.addr = reinterpret_cast<uint64_t>(requests[index].data.data() + filled[index]);
+            sqe.len = static_cast<uint32_t>(std::min<size_t>(requests[index].data.size() - filled[index], 1u << 30));
+            sqe.off = filled[index];
+        }, results);
+
+        std::vector<size_t> next;
+        for (size_t index : pending) {
+            int result = results[index];
+            if (result < 0 && result != -EINTR && result != -EAGAIN) {
+                closeFiles(fds);
+                throw std::runtime_error("Failed to read input file: " + requests[index].path.string());
+            }
+            if (result < 0) {
+                next.push_back(index);
+                continue;
+            }
+
+            size_t requested = requests[index].data.size() - filled[index];
+            filled[index] += static_cast<size_t>(result);
+            if (result == 0 || static_cast<size_t>(result) < requested) {
+                requests[index].data.resize(filled[index]);
+            } else {
+                requests[index].data.resize(requests[index].data.size() * 2);
+                next.push_back(index);
+            }
+        }
+        pending.swap(next);
+    }
+
+    closeFiles(fds);
+}
+
+void IoUringFileBackend::writeFiles(std::vector<FileRequest>& requests) {
+    std::vector<int> fds = openFiles(requests, O_WRONLY | O_CREAT | O_TRUNC);
+    for (size_t i = 0; i < requests.size(); ++i) {
+        if (fds[i] < 0) {
+            closeFiles(fds);
+            throw std::runtime_error("Failed to create output file: " + requests[i].path.string());
+        }
+    }
+
+    std::vector<size_t> written(requests.size(), 0);
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < requests.size(); ++i) {
+        if (!requests[i].data.empty()) {
+            pending.push_back(i);
+        }
+    }
+
+    std::vector<int> results(requests.size(), 0);
+    while (!pending.empty()) {
+        run(pending, [&](io_uring_sqe& sqe, size_t index) {
+            sqe.opcode = IORING_OP_WRITE;
+            sqe.fd = fds[index];
+            sqe.addr = reinterpret_cast<uint64_t>(requests[index].data.data() + written[index]);
+            sqe.len = static_cast<uint32_t>(std::min<size_t>(requests[index].data.size() - written[index], 1u << 30));
+            sqe.off = written[index];
+        }, results);
+
+        // Resubmit short writes for the remainder
+        std::vector<size_t> next;
+        for (size_t index : pending) {
+            int result = results[index];
+            if (result < 0 && result != -EINTR && result != -EAGAIN) {
+                closeFiles(fds);
+                throw std::runtime_error("Failed to write output file: " + requests[index].path.string());
+            }
+            if (result > 0) {
+                written[index] += static_cast<size_t>(result);
+            }
+            if (written[index] < requests[index].data.size()) {
+                next.push_back(index);
+            }
+        }
+        pending.swap(next);
+    }
+
+    closeFiles(fds);
+}
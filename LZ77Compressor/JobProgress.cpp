@@ -0,0 +1,39 @@
+#include "JobProgress.h"
+#include <algorithm>
+
+ProgressReporter::ProgressReporter(ProgressCallback callback, uint64_t totalBytes, std::chrono::milliseconds interval)
+    : m_callback(std::move(callback)), m_totalBytes(totalBytes), m_interval(interval) {
+    if (m_callback) {
+        m_thread = std::thread(&ProgressReporter::run, this);
+    }
+}
+
+ProgressReporter::~ProgressReporter() {
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wake.notify_one();
+        m_thread.join();
+    }
+}
+
+void ProgressReporter::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_wake.wait_for(lock, m_interval, [this]() { return m_stopping; })) {
+        report();
+    }
+    // A last report so that the final state is always delivered
+    report();
+}
+
+void ProgressReporter::report() {
+    uint64_t done = m_doneBytes.load(std::memory_order_relaxed);
+    int percentage = m_totalBytes == 0 ? 100
+                                       : static_cast<int>(std::min<uint64_t>(100, done * 100 / m_totalBytes));
+    if (percentage != m_lastPercentage) {
+        m_lastPercentage = percentage;
+        m_callback(percentage);
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef JOBPROGRESS_H
+#define JOBPROGRESS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+// Called with the completed percentage as a job advances
+using ProgressCallback = std::function<void(int percentage)>;
+
+// Thrown from inside a job once its cancellation token has been triggered
+class JobCancelled : public std::runtime_error {
+public:
+    JobCancelled() : std::runtime_error("Operation cancelled.") {}
+};
+
+// Shared flag that asks a running job to stop. cancel() may be called from any
+// thread; the job polls the flag in its inner loops and unwinds with JobCancelled.
+class CancellationToken {
+public:
+    void cancel() { m_cancelled.store(true, std::memory_order_relaxed); }
+    bool isCancelled() const { return m_cancelled.load(std::memory_order_relaxed); }
+
+    void throwIfCancelled() const {
+        if (isCancelled()) {
+            throw JobCancelled();
+        }
+    }
+
+private:
+    std::atomic<bool> m_cancelled{ false };
+};
+
+// Jobs take their token as an optional pointer
+inline void throwIfCancelled(const CancellationToken *token) {
+    if (token) {
+        token->throwIfCancelled();
+    }
+}
+
+// Counts processed bytes from any number of threads and reports the percentage
+// from its own thread at a capped rate, and only when it changes
+class ProgressReporter {
+public:
+    ProgressReporter(ProgressCallback callback, uint64_t totalBytes,
+                     std::chrono::milliseconds interval = std::chrono::milliseconds(100));
+    ~ProgressReporter();
+
+    void add(uint64_t bytes) { m_doneBytes.fetch_add(bytes, std::memory_order_relaxed); }
+
+    ProgressReporter(const ProgressReporter&) = delete;
+    ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+private:
+    void run();
+    void report();
+
+    ProgressCallback m_callback;
+    uint64_t m_totalBytes;
+    std::chrono::milliseconds m_interval;
+    std::atomic<uint64_t> m_doneBytes{ 0 };
+    int m_lastPercentage = -1;
+    bool m_stopping = false;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::thread m_thread;
+};
+
+#endif // JOBPROGRESS_H
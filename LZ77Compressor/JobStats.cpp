@@ -0,0 +1,132 @@
+#include "JobStats.h"
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+std::string jsonString(const std::string& value) {
+    std::ostringstream out;
+    out << '"';
+    for (unsigned char c : value) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c)
+                << std::dec << std::setfill(' ');
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+std::string jsonArray(const std::array<uint64_t, HISTOGRAM_BUCKETS>& values) {
+    std::ostringstream out;
+    out << '[';
+    for (size_t i = 0; i < values.size(); ++i) {
+        out << (i == 0 ? "" : ", ") << values[i];
+    }
+    out << ']';
+    return out.str();
+}
+
+double seconds(uint64_t nanoseconds) {
+    return static_cast<double>(nanoseconds) / 1e9;
+}
+
+} // namespace
+
+void TokenStats::merge(const TokenStats& other) {
+    tokens += other.tokens;
+    literalBytes += other.literalBytes;
+    matchedBytes += other.matchedBytes;
+    repeatMatches += other.repeatMatches;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        matchLengths[i] += other.matchLengths[i];
+        offsets[i] += other.offsets[i];
+    }
+}
+
+void StageTimes::merge(const StageTimes& other) {
+    ioNanoseconds += other.ioNanoseconds;
+    matchFindingNanoseconds += other.matchFindingNanoseconds;
+    encodingNanoseconds += other.encodingNanoseconds;
+    decodingNanoseconds += other.decodingNanoseconds;
+    tuningNanoseconds += other.tuningNanoseconds;
+    filteringNanoseconds += other.filteringNanoseconds;
+}
+
+std::string JobStats::toJson() const {
+    uint64_t tokenBytes = tokens.literalBytes + tokens.matchedBytes;
+
+    std::ostringstream out;
+    out << std::setprecision(6);
+    out << "{\n";
+    out << "  \"operation\": " << jsonString(operation) << ",\n";
+    out << "  \"ioBackend\": " << jsonString(ioBackend) << ",\n";
+    out << "  \"simdLevel\": " << jsonString(simdLevel) << ",\n";
+    out << "  \"bytesIn\": " << bytesIn << ",\n";
+    out << "  \"bytesOut\": " << bytesOut << ",\n";
+    out << "  \"ratio\": " << (bytesIn == 0 ? 0.0 : static_cast<double>(bytesOut) / bytesIn) << ",\n";
+    out << "  \"resumedEntries\": " << resumedEntries << ",\n";
+    out << "  \"tokens\": " << tokens.tokens << ",\n";
+    out << "  \"literalBytes\": " << tokens.literalBytes << ",\n";
+    out << "  \"matchedBytes\": " << tokens.matchedBytes << ",\n";
+    out << "  \"repeatMatches\": " << tokens.repeatMatches << ",\n";
+    out << "  \"literalRatio\": " << (tokenBytes == 0 ? 0.0 : static_cast<double>(tokens.literalBytes) / tokenBytes) << ",\n";
+    out << "  \"matchLengthHistogram\": " << jsonArray(tokens.matchLengths) << ",\n";
+    out << "  \"offsetHistogram\": " << jsonArray(tokens.offsets) << ",\n";
+    out << "  \"time\": {\n";
+    out << "    \"wallSeconds\": " << wallSeconds << ",\n";
+    out << "    \"cpuSeconds\": " << cpuSeconds << ",\n";
+    out << "    \"ioSeconds\": " << seconds(stages.ioNanoseconds) << ",\n";
+    out << "    \"matchFindingSeconds\": " << seconds(stages.matchFindingNanoseconds) << ",\n";
+    out << "    \"encodingSeconds\": " << seconds(stages.encodingNanoseconds) << ",\n";
+    out << "    \"decodingSeconds\": " << seconds(stages.decodingNanoseconds) << ",\n";
+    out << "    \"tuningSeconds\": " << seconds(stages.tuningNanoseconds) << ",\n";
+    out << "    \"filteringSeconds\": " << seconds(stages.filteringNanoseconds) << "\n";
+    out << "  },\n";
+    out << "  \"bufferPool\": {\n";
+    out << "    \"allocations\": " << buffers.allocations << ",\n";
+    out << "    \"reuses\": " << buffers.reuses << ",\n";
+    out << "    \"peakOutstanding\": " << buffers.peakOutstanding << ",\n";
+    out << "    \"peakBytes\": " << buffers.peakBytes << "\n";
+    out << "  },\n";
+    out << "  \"files\": [";
+    for (size_t i = 0; i < files.size(); ++i) {
+        const FileStats& file = files[i];
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    { \"path\": " << jsonString(file.path) << ", \"bytesIn\": " << file.bytesIn
+            << ", \"bytesOut\": " << file.bytesOut << ", \"tokens\": " << file.tokens;
+        if (file.windowSize != 0) {
+            out << ", \"windowSize\": " << file.windowSize << ", \"maxMatchLength\": " << file.maxMatchLength;
+        }
+        if (!file.filters.empty()) {
+            out << ", \"filters\": " << jsonString(file.filters);
+        }
+        out << " }";
+    }
+    out << (files.empty() ? "]\n" : "\n  ]\n");
+    out << "}\n";
+    return out.str();
+}
+
+JobClock::JobClock() : m_wallStart(std::chrono::steady_clock::now()), m_cpuStart(std::clock()) {}
+
+void JobClock::stop(JobStats& stats) const {
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - m_wallStart;
+    stats.wallSeconds = wall.count();
+    stats.cpuSeconds = static_cast<double>(std::clock() - m_cpuStart) / CLOCKS_PER_SEC;
+}
+
+void writeJobReport(const JobStats& stats, const std::filesystem::path& reportFile) {
+    std::ofstream report(reportFile, std::ios::binary | std::ios::trunc);
+    report << stats.toJson();
+    if (!report) {
+        throw std::runtime_error("Failed to write report file: " + reportFile.string());
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef JOBSTATS_H
+#define JOBSTATS_H
+
+#include "BufferPool.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Histogram buckets: bucket 0 counts zeros, bucket k counts values in [2^(k-1), 2^k)
+const size_t HISTOGRAM_BUCKETS = 17;
+
+// Shape of the token stream produced or consumed by a job
+struct TokenStats {
+    uint64_t tokens = 0;
+    uint64_t literalBytes = 0;   // One next character per token
+    uint64_t matchedBytes = 0;   // Bytes copied from the window
+    uint64_t repeatMatches = 0;  // Matches coded as one of the recent offsets
+    std::array<uint64_t, HISTOGRAM_BUCKETS> matchLengths{};
+    std::array<uint64_t, HISTOGRAM_BUCKETS> offsets{};
+
+    void add(uint16_t offset, uint16_t length) {
+        ++tokens;
+        ++literalBytes;
+        matchedBytes += length;
+        ++matchLengths[histogramBucket(length)];
+        ++offsets[histogramBucket(offset)];
+    }
+
+    void merge(const TokenStats& other);
+
+    static size_t histogramBucket(uint16_t value) {
+        size_t bucket = 0;
+        while (value != 0) {
+            ++bucket;
+            value >>= 1;
+        }
+        return bucket;
+    }
+};
+
+// Wall time spent in each stage, summed over the threads that ran it
+struct StageTimes {
+    uint64_t ioNanoseconds = 0;
+    uint64_t matchFindingNanoseconds = 0;
+    uint64_t encodingNanoseconds = 0;
+    uint64_t decodingNanoseconds = 0;
+    uint64_t tuningNanoseconds = 0;
+    uint64_t filteringNanoseconds = 0;
+
+    void merge(const StageTimes& other);
+};
+
+// Adds the time spent in a scope to a counter owned by the calling thread
+class StageTimer {
+public:
+    explicit StageTimer(uint64_t& nanoseconds)
+        : m_nanoseconds(nanoseconds), m_start(std::chrono::steady_clock::now()) {}
+
+    ~StageTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - m_start;
+        m_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    uint64_t& m_nanoseconds;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// One archive entry's contribution to a job
+struct FileStats {
+    std::string path;
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    uint64_t tokens = 0;
+    int windowSize = 0;       // Match finder settings of a compressed file; 0 for others
+    int maxMatchLength = 0;
+    std::string filters;      // Filter chain of a compressed file, in parseFilter() notation
+};
+
+// Everything measured during one compression or extraction job
+struct JobStats {
+    std::string operation;
+    std::string ioBackend;
+    std::string simdLevel;
+    std::vector<FileStats> files;
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    uint64_t resumedEntries = 0;   // Entries an interrupted run had already completed
+    TokenStats tokens;
+    StageTimes stages;
+    double wallSeconds = 0;
+    double cpuSeconds = 0;
+    BufferPool::Stats buffers;
+
+    std::string toJson() const;
+};
+
+// Measures wall and process CPU time from construction until stop()
+class JobClock {
+public:
+    JobClock();
+    void stop(JobStats& stats) const;
+
+private:
+    std::chrono::steady_clock::time_point m_wallStart;
+    std::clock_t m_cpuStart;
+};
+
+// Write the report as a JSON document, replacing any existing file
+void writeJobReport(const JobStats& stats, const std::filesystem::path& reportFile);
+
+#endif // JOBSTATS_H
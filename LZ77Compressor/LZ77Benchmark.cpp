@@ -0,0 +1,259 @@
+// Throughput benchmark for the block codecs.
+//
+// Usage: lz77_benchmark [--min-time seconds] [--codec name]... [--window size]... [--simd level]
+//                       [file or directory]...
+//
+// Every input is split into archive-sized blocks and run through each registered codec
+// (or those named) at each window size, reporting MB/s of raw data, the payload ratio
+// and the process's peak resident memory. Blocks a codec can't shrink count as stored,
+// as they would in an archive. Synthetic inputs are always included. --simd runs the
+// kernels of a lower instruction set level than the CPU's: scalar, sse2, avx2 or avx512.
+
+#include "CodecRegistry.h"
+#include "SimdKernels.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Size of each generated input
+const size_t SYNTHETIC_SIZE = 256 * 1024;
+
+struct BenchmarkInput {
+    std::string name;
+    std::vector<char> data;
+};
+
+struct BenchmarkResult {
+    size_t payloadBytes = 0;
+    double compressSeconds = 0;
+    double decompressSeconds = 0;
+    size_t iterations = 0;
+};
+
+// Function prototypes
+std::vector<BenchmarkInput> syntheticInputs();
+void addCorpus(const fs::path& path, std::vector<BenchmarkInput>& inputs);
+BenchmarkResult runBenchmark(const std::vector<char>& data, const Codec& codec, const LZ77Settings& settings,
+                             double minSeconds);
+size_t peakMemoryBytes();
+
+int main(int argc, char** argv) {
+    try {
+        double minSeconds = 0.5;
+        std::vector<int> windowSizes;
+        std::vector<const Codec*> codecs;
+        std::vector<BenchmarkInput> inputs = syntheticInputs();
+
+        for (int i = 1; i < argc; ++i) {
+            std::string argument = argv[i];
+            if (argument == "--min-time" && i + 1 < argc) {
+                minSeconds = std::atof(argv[++i]);
+            } else if (argument == "--codec" && i + 1 < argc) {
+                const Codec* codec = findCodec(std::string(argv[++i]));
+                if (!codec) {
+                    throw std::runtime_error("Unknown codec: " + std::string(argv[i]));
+                }
+                codecs.push_back(codec);
+            } else if (argument == "--window" && i + 1 < argc) {
+                windowSizes.push_back(std::atoi(argv[++i]));
+            } else if (argument == "--simd" && i + 1 < argc) {
+                SimdLevel level;
+                if (!parseSimdLevel(argv[++i], level)) {
+                    throw std::runtime_error("Unknown SIMD level: " + std::string(argv[i]));
+                }
+                setSimdLevel(level);
+            } else {
+                addCorpus(argument, inputs);
+            }
+        }
+        if (codecs.empty()) {
+            codecs = registeredCodecs();
+        }
+        if (windowSizes.empty()) {
+            windowSizes = { 1024, LZ77Settings().windowSize, 16384 };
+        }
+        for (int windowSize : windowSizes) {
+            if (windowSize < 1 || windowSize > UINT16_MAX) {
+                throw std::runtime_error("Window size must be between 1 and 65535.");
+            }
+        }
+
+        std::printf("SIMD kernels: %s (CPU supports %s)\n\n", simdLevelName(simdKernels().level),
+                    simdLevelName(detectedSimdLevel()));
+        std::printf("%-32s %-8s %8s %10s %8s %14s %16s %12s\n",
+                    "input", "codec", "window", "bytes", "ratio", "compress MB/s", "decompress MB/s", "peak RSS MB");
+
+        for (const auto& input : inputs) {
+            for (const Codec* codec : codecs) {
+                for (int windowSize : windowSizes) {
+                    LZ77Settings settings;
+                    settings.windowSize = windowSize;
+
+                    BenchmarkResult result = runBenchmark(input.data, *codec, settings, minSeconds);
+                    double megabytes = static_cast<double>(input.data.size()) * result.iterations / (1024.0 * 1024.0);
+                    double ratio = input.data.empty() ? 0.0 : static_cast<double>(result.payloadBytes) / input.data.size();
+
+                    std::printf("%-32s %-8s %8d %10zu %8.3f %14.2f %16.2f %12.1f\n",
+                                input.name.c_str(), codec->name(), windowSize, input.data.size(), ratio,
+                                megabytes / result.compressSeconds, megabytes / result.decompressSeconds,
+                                peakMemoryBytes() / (1024.0 * 1024.0));
+                    std::fflush(stdout);
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Inputs that cover the match finder's extremes: no matches, long runs and text-like repeats
+std::vector<BenchmarkInput> syntheticInputs() {
+    std::mt19937 random(12345);
+    std::vector<BenchmarkInput> inputs;
+
+    BenchmarkInput noise{ "synthetic/random", std::vector<char>(SYNTHETIC_SIZE) };
+    for (auto& byte : noise.data) {
+        byte = static_cast<char>(random() & 0xFF);
+    }
+    inputs.push_back(std::move(noise));
+
+    BenchmarkInput zeros{ "synthetic/zeros", std::vector<char>(SYNTHETIC_SIZE, '\0') };
+    inputs.push_back(std::move(zeros));
+
+    // Words drawn from a small vocabulary give short, frequent matches at varied offsets
+    const char* words[] = { "the ", "archive ", "block ", "token ", "window ", "match ", "offset ",
+                            "length ", "of ", "and ", "compress ", "data ", "file ", "a ", "in ", "\n" };
+    BenchmarkInput text{ "synthetic/text", {} };
+    while (text.data.size() < SYNTHETIC_SIZE) {
+        const char* word = words[random() % (sizeof(words) / sizeof(words[0]))];
+        text.data.insert(text.data.end(), word, word + std::char_traits<char>::length(word));
+    }
+    text.data.resize(SYNTHETIC_SIZE);
+    inputs.push_back(std::move(text));
+
+    // Runs of a repeated byte with random lengths
+    BenchmarkInput runs{ "synthetic/runs", {} };
+    while (runs.data.size() < SYNTHETIC_SIZE) {
+        runs.data.insert(runs.data.end(), 1 + random() % 64, static_cast<char>(random() & 0xFF));
+    }
+    runs.data.resize(SYNTHETIC_SIZE);
+    inputs.push_back(std::move(runs));
+
+    return inputs;
+}
+
+void addCorpus(const fs::path& path, std::vector<BenchmarkInput>& inputs) {
+    if (fs::is_directory(path)) {
+        std::vector<fs::path> files;
+        for (const auto& entry : fs::recursive_directory_iterator(path)) {
+            if (entry.is_regular_file()) {
+                files.push_back(entry.path());
+            }
+        }
+        std::sort(files.begin(), files.end());
+        for (const auto& file : files) {
+            addCorpus(file, inputs);
+        }
+        return;
+    }
+
+    std::ifstream infile(path, std::ios::binary);
+    if (!infile) {
+        throw std::runtime_error("Failed to open benchmark input: " + path.string());
+    }
+    BenchmarkInput input;
+    input.name = path.filename().string();
+    input.data.assign(std::istreambuf_iterator<char>(infile), std::istreambuf_iterator<char>());
+    if (!input.data.empty()) {
+        inputs.push_back(std::move(input));
+    }
+}
+
+// Repeat a full compress and decompress pass over the input until minSeconds have been spent compressing
+BenchmarkResult runBenchmark(const std::vector<char>& data, const Codec& codec, const LZ77Settings& settings,
+                             double minSeconds) {
+    using Clock = std::chrono::steady_clock;
+
+    BenchmarkResult result;
+    CodecWorkspace workspace;
+    std::vector<std::vector<char>> payloads;
+    std::vector<bool> encoded;
+    std::vector<char> decoded;
+    TokenStats tokenStats;
+
+    do {
+        payloads.clear();
+        encoded.clear();
+        result.payloadBytes = 0;
+
+        auto start = Clock::now();
+        for (size_t offset = 0; offset < data.size(); offset += BLOCK_SIZE) {
+            size_t blockSize = std::min(BLOCK_SIZE, data.size() - offset);
+            payloads.emplace_back();
+            payloads.back().reserve(codec.bound(blockSize));
+            encoded.push_back(codec.compress(data.data() + offset, blockSize, settings, workspace, payloads.back()));
+            result.payloadBytes += encoded.back() ? payloads.back().size() : blockSize;
+        }
+        result.compressSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+
+        for (size_t block = 0; block < payloads.size(); ++block) {
+            size_t offset = block * BLOCK_SIZE;
+            size_t blockSize = std::min(BLOCK_SIZE, data.size() - offset);
+            if (!encoded[block]) {
+                continue;
+            }
+            decoded.resize(blockSize);
+            start = Clock::now();
+            codec.decompress(payloads[block].data(), payloads[block].size(), decoded.data(), blockSize, &tokenStats);
+            result.decompressSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+
+            if (!std::equal(decoded.begin(), decoded.end(), data.begin() + offset)) {
+                throw std::runtime_error("Decoded data does not match the input.");
+            }
+        }
+
+        ++result.iterations;
+    } while (result.compressSeconds < minSeconds);
+
+    return result;
+}
+
+size_t peakMemoryBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
@@ -0,0 +1,497 @@
+#include "LZ77Codec.h"
+#include "SimdKernels.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <type_traits>
+#include <ctime>
+
+LZ77Settings settingsForLevel(int level) {
+    // Each level doubles the window, up to the 16-bit offset limit; higher levels also allow longer matches
+    LZ77Settings settings;
+    level = std::max(1, std::min(level, 9));
+    settings.windowSize = std::min(256 << level, 65535);
+    settings.maxMatchLength = level <= 4 ? 18 : level <= 6 ? 64 : 258;
+    return settings;
+}
+
+namespace {
+
+// Auto-tuning candidates, from fastest to slowest
+const LZ77Settings TUNING_CANDIDATES[] = {
+    { 1024, 18 },
+    { 1024, 258 },
+    { 4096, 18 },
+    { 4096, 258 },
+    { 16384, 64 },
+    { 16384, 258 },
+};
+
+// Offsets of the last REPEAT_OFFSETS distinct matches, most recent first. The match
+// finder, the encoder and the decoder each keep one and update it the same way.
+struct RepeatOffsets {
+    uint16_t offsets[REPEAT_OFFSETS] = { 1, 2, 3, 4 };
+
+    // Slot holding offset, or REPEAT_OFFSETS if it isn't cached
+    size_t find(uint16_t offset) const {
+        return static_cast<size_t>(std::find(offsets, offsets + REPEAT_OFFSETS, offset) - offsets);
+    }
+
+    // Move a match's offset to the front, dropping the oldest if it is new
+    void update(uint16_t offset) {
+        size_t slot = std::min(find(offset), REPEAT_OFFSETS - 1);
+        for (; slot > 0; --slot) {
+            offsets[slot] = offsets[slot - 1];
+        }
+        offsets[0] = offset;
+    }
+};
+
+// A recent-offset match this long is taken without searching the window
+const size_t GOOD_REPEAT_LENGTH = 12;
+
+// The match finder for one window size and maximum match length. Kernels instantiated
+// with both fixed get constant loop bounds; a zero takes the value from settings.
+template <size_t FixedWindowSize, size_t FixedMaxMatchLength, typename Sink>
+bool matchKernel(const char* data, size_t size, const LZ77Settings& settings, Sink& sink) {
+    const size_t WINDOW_SIZE = FixedWindowSize ? FixedWindowSize : static_cast<size_t>(settings.windowSize);
+    const size_t BUFFER_SIZE = FixedMaxMatchLength ? FixedMaxMatchLength : static_cast<size_t>(settings.maxMatchLength);
+    const SimdKernels& simd = simdKernels();
+
+    RepeatOffsets repeats;
+    size_t pos = 0;
+    while (pos < size) {
+        size_t limit = std::min(BUFFER_SIZE, size - pos);
+        size_t maxMatchLength = 0;
+        size_t bestOffset = 0;
+
+        // Recent offsets first: their tokens are two bytes shorter, so the window has to
+        // beat them by more than a byte, and a long enough match skips the window
+        for (uint16_t offset : repeats.offsets) {
+            if (offset <= pos && offset <= WINDOW_SIZE) {
+                size_t length = simd.matchLength(data + pos - offset, data + pos, limit);
+                if (length > maxMatchLength) {
+                    maxMatchLength = length;
+                    bestOffset = offset;
+                }
+            }
+        }
+
+        if (maxMatchLength < std::min(limit, GOOD_REPEAT_LENGTH)) {
+            // A window match has to reach needed bytes to win, so candidates that differ
+            // at its first or last byte are skipped without comparing the rest
+            size_t needed = maxMatchLength + 2;
+            size_t startWindow = pos > WINDOW_SIZE ? pos - WINDOW_SIZE : 0;
+            for (size_t i = startWindow; needed <= limit; ++i) {
+                i = simd.findCandidate(data, i, pos, pos, needed);
+                if (i == pos) {
+                    break;
+                }
+                size_t length = simd.matchLength(data + i, data + pos, limit);
+                if (length >= needed) {
+                    maxMatchLength = length;
+                    bestOffset = pos - i;
+                    needed = length + 1;
+                }
+            }
+        }
+
+        char nextChar = (pos + maxMatchLength < size) ? data[pos + maxMatchLength] : '\0';
+        Token token = { static_cast<uint16_t>(bestOffset), static_cast<uint16_t>(maxMatchLength), nextChar };
+
+        LZ77_TRACE(LZ77_TRACE_TOKEN, "Creating Token - Offset: " << token.offset
+                                     << ", Length: " << token.length
+                                     << ", Next Char: " << token.next_char);
+
+        if (!sink(token)) {
+            return false;
+        }
+
+        if (maxMatchLength > 0) {
+            repeats.update(token.offset);
+        }
+        pos += maxMatchLength + 1;
+    }
+    return true;
+}
+
+// Run the match finder over data, handing each token to sink. Stops early and
+// returns false if the sink refuses a token.
+template <typename Sink>
+bool findTokens(const char* data, size_t size, const LZ77Settings& settings, Sink&& sink) {
+    using SinkType = typename std::remove_reference<Sink>::type;
+    using Kernel = bool (*)(const char*, size_t, const LZ77Settings&, SinkType&);
+    struct KernelEntry {
+        int windowSize;
+        int maxMatchLength;
+        Kernel kernel;
+    };
+
+    // Kernels for the settings of every level and tuning candidate; anything else,
+    // such as a benchmark's window, runs the generic one
+    static const KernelEntry KERNELS[] = {
+        { 512, 18, &matchKernel<512, 18, SinkType> },
+        { 1024, 18, &matchKernel<1024, 18, SinkType> },
+        { 1024, 258, &matchKernel<1024, 258, SinkType> },
+        { 2048, 18, &matchKernel<2048, 18, SinkType> },
+        { 4096, 18, &matchKernel<4096, 18, SinkType> },
+        { 4096, 258, &matchKernel<4096, 258, SinkType> },
+        { 8192, 64, &matchKernel<8192, 64, SinkType> },
+        { 16384, 64, &matchKernel<16384, 64, SinkType> },
+        { 16384, 258, &matchKernel<16384, 258, SinkType> },
+        { 32768, 258, &matchKernel<32768, 258, SinkType> },
+        { 65535, 258, &matchKernel<65535, 258, SinkType> },
+    };
+
+    Kernel kernel = &matchKernel<0, 0, SinkType>;
+    for (const auto& entry : KERNELS) {
+        if (entry.windowSize == settings.windowSize && entry.maxMatchLength == settings.maxMatchLength) {
+            kernel = entry.kernel;
+            break;
+        }
+    }
+    return kernel(data, size, settings, sink);
+}
+
+void writeToken(const Token& token, char* out) {
+    out[0] = static_cast<char>(token.offset & 0xFF);
+    out[1] = static_cast<char>(token.offset >> 8);
+    out[2] = static_cast<char>(token.length & 0xFF);
+    out[3] = static_cast<char>(token.length >> 8);
+    out[4] = token.next_char;
+}
+
+// Repeat-offset token tags carry the offset in their top three bits and the length in the rest
+const int TAG_LENGTH_BITS = 5;
+
+void appendVarUInt(std::vector<char>& payload, uint64_t value) {
+    while (value >= 0x80) {
+        payload.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    payload.push_back(static_cast<char>(value));
+}
+
+uint64_t parseVarUInt(const uint8_t*& bytes, const uint8_t* end) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (bytes == end) {
+            break;
+        }
+        uint8_t byte = *bytes++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Truncated token in compressed data.");
+}
+
+// CPU time of the calling thread, so tuning isn't skewed by compressor threads sharing
+// the cores; wall time where the platform has no per-thread clock
+double threadCpuSeconds() {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) == 0) {
+        return static_cast<double>(now.tv_sec) + static_cast<double>(now.tv_nsec) * 1e-9;
+    }
+#endif
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+void decodeTokens(const char* payload, size_t payloadSize, char* out, size_t rawSize, TokenStats* tokenStats) {
+    const SimdKernels& simd = simdKernels();
+    size_t produced = 0;
+
+    for (size_t pos = 0; pos + TOKEN_SIZE <= payloadSize; pos += TOKEN_SIZE) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(payload + pos);
+        uint16_t offset = static_cast<uint16_t>(bytes[0]) | (static_cast<uint16_t>(bytes[1]) << 8);
+        uint16_t length = static_cast<uint16_t>(bytes[2]) | (static_cast<uint16_t>(bytes[3]) << 8);
+        char nextChar = payload[pos + 4];
+
+        if (produced == rawSize) {
+            throw std::runtime_error("Block size mismatch in compressed data.");
+        }
+        if (offset > produced || (offset == 0 && length != 0) || produced + length > rawSize) {
+            throw std::runtime_error("Invalid token offset in compressed data.");
+        }
+        if (tokenStats) {
+            tokenStats->add(offset, length);
+        }
+
+        simd.copyMatch(out + produced, offset, length);
+        produced += length;
+        if (produced < rawSize) {
+            out[produced++] = nextChar;
+        }
+    }
+
+    if (produced != rawSize) {
+        throw std::runtime_error("Block size mismatch in compressed data.");
+    }
+}
+
+void serializeRepeatTokens(const std::vector<Token>& tokens, size_t rawSize, std::vector<char>& payload,
+                           TokenStats* tokenStats) {
+    appendVarUInt(payload, tokens.size());
+
+    RepeatOffsets repeats;
+    size_t produced = 0;
+    for (const auto& token : tokens) {
+        uint8_t tag = 0;
+        if (token.length > 0) {
+            size_t slot = repeats.find(token.offset);
+            uint8_t source = slot < REPEAT_OFFSETS ? static_cast<uint8_t>(slot + 1) : TAG_OFFSET;
+            tag = static_cast<uint8_t>(source << TAG_LENGTH_BITS | std::min<size_t>(token.length - 1, LONG_LENGTH));
+            if (tokenStats && slot < REPEAT_OFFSETS) {
+                ++tokenStats->repeatMatches;
+            }
+        }
+        payload.push_back(static_cast<char>(tag));
+
+        if (token.length > LONG_LENGTH) {
+            appendVarUInt(payload, token.length - 1 - LONG_LENGTH);
+        }
+        if (tag >> TAG_LENGTH_BITS == TAG_OFFSET) {
+            payload.push_back(static_cast<char>(token.offset & 0xFF));
+            payload.push_back(static_cast<char>(token.offset >> 8));
+        }
+        if (token.length > 0) {
+            repeats.update(token.offset);
+        }
+
+        produced += token.length;
+        if (produced < rawSize) {
+            payload.push_back(token.next_char);
+            ++produced;
+        }
+        if (tokenStats) {
+            tokenStats->add(token.offset, token.length);
+        }
+    }
+}
+
+void decodeRepeatTokens(const char* payload, size_t payloadSize, char* out, size_t rawSize,
+                        TokenStats* tokenStats) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(payload);
+    const uint8_t* end = bytes + payloadSize;
+    uint64_t count = parseVarUInt(bytes, end);
+
+    const SimdKernels& simd = simdKernels();
+    RepeatOffsets repeats;
+    size_t produced = 0;
+    for (uint64_t index = 0; index < count; ++index) {
+        if (bytes == end) {
+            throw std::runtime_error("Truncated token in compressed data.");
+        }
+        uint8_t tag = *bytes++;
+        uint8_t source = tag >> TAG_LENGTH_BITS;
+        uint64_t length = 0;
+        uint16_t offset = 0;
+
+        if (source != 0) {
+            length = (tag & LONG_LENGTH) + 1;
+            if (length > LONG_LENGTH) {
+                length += parseVarUInt(bytes, end);
+            }
+            if (source < TAG_OFFSET) {
+                offset = repeats.offsets[source - 1];
+            } else if (source == TAG_OFFSET && end - bytes >= 2) {
+                offset = static_cast<uint16_t>(bytes[0] | (bytes[1] << 8));
+                bytes += 2;
+            } else {
+                throw std::runtime_error("Invalid token in compressed data.");
+            }
+        } else if (tag != 0) {
+            throw std::runtime_error("Invalid token in compressed data.");
+        }
+
+        if (length > UINT16_MAX) {
+            throw std::runtime_error("Invalid token in compressed data.");
+        }
+        if (offset > produced || (offset == 0 && length != 0) || length > rawSize - produced) {
+            throw std::runtime_error("Invalid token offset in compressed data.");
+        }
+        if (tokenStats) {
+            tokenStats->add(offset, static_cast<uint16_t>(length));
+            if (source != 0 && source < TAG_OFFSET) {
+                ++tokenStats->repeatMatches;
+            }
+        }
+
+        simd.copyMatch(out + produced, offset, length);
+        produced += length;
+        if (length > 0) {
+            repeats.update(offset);
+        }
+
+        if (produced < rawSize) {
+            if (bytes == end) {
+                throw std::runtime_error("Truncated token in compressed data.");
+            }
+            out[produced++] = static_cast<char>(*bytes++);
+        }
+    }
+
+    if (produced != rawSize || bytes != end) {
+        throw std::runtime_error("Block size mismatch in compressed data.");
+    }
+}
+
+bool compressData(const char* data, size_t size, std::vector<Token>& tokens, const LZ77Settings& settings,
+                  const CancellationToken* cancel, size_t maxTokens) {
+    // Tokens between cancellation checks; a block with a large window takes long enough to need them
+    const size_t CANCEL_CHECK_TOKENS = 4096;
+
+    tokens.clear();
+    return findTokens(data, size, settings, [&tokens, cancel, maxTokens](const Token& token) {
+        if (tokens.size() == maxTokens) {
+            return false;
+        }
+        if (tokens.size() % CANCEL_CHECK_TOKENS == 0) {
+            throwIfCancelled(cancel);
+        }
+        tokens.push_back(token);
+        return true;
+    });
+}
+
+LZ77Settings tuneSettings(const char* sample, size_t size, double targetThroughput) {
+    LZ77Settings best = TUNING_CANDIDATES[0];
+    double bestRatio = 0;
+    double bestScore = 0;
+    double fastestThroughput = 0;
+    bool targetMet = false;
+
+    std::vector<Token> tokens;
+    std::vector<char> payload;
+    tokens.reserve(size / MIN_REPEAT_TOKEN_SIZE);
+    for (const LZ77Settings& candidate : TUNING_CANDIDATES) {
+        double start = threadCpuSeconds();
+        bool complete = compressData(sample, size, tokens, candidate, nullptr, size / MIN_REPEAT_TOKEN_SIZE);
+        payload.clear();
+        if (complete) {
+            serializeRepeatTokens(tokens, size, payload, nullptr);
+        }
+        double elapsed = threadCpuSeconds() - start;
+
+        // Blocks that don't shrink are stored; the clock is floored so a tiny sample can't divide by zero
+        size_t compressedSize = complete ? std::min(std::max<size_t>(payload.size(), 1), size) : size;
+        double ratio = static_cast<double>(size) / compressedSize;
+        double seconds = std::max(elapsed, 1e-6);
+        double throughput = size / seconds;
+
+        bool better;
+        if (targetThroughput > 0) {
+            bool meetsTarget = throughput >= targetThroughput;
+            better = meetsTarget ? !targetMet || ratio > bestRatio
+                                 : !targetMet && throughput > fastestThroughput;
+            targetMet = targetMet || meetsTarget;
+        } else {
+            better = ratio / seconds > bestScore;
+        }
+        if (better) {
+            best = candidate;
+            bestRatio = ratio;
+            bestScore = ratio / seconds;
+        }
+        fastestThroughput = std::max(fastestThroughput, throughput);
+
+        LZ77_TRACE(LZ77_TRACE_INFO, "Tuning window " << candidate.windowSize << ", max match " << candidate.maxMatchLength
+                                    << ": ratio " << ratio << ", " << throughput / (1024 * 1024) << " MB/s");
+    }
+    return best;
+}
+
+void serializeTokens(const std::vector<Token>& tokens, std::vector<char>& payload) {
+    for (const auto& token : tokens) {
+        payload.push_back(static_cast<char>(token.offset & 0xFF));
+        payload.push_back(static_cast<char>(token.offset >> 8));
+        payload.push_back(static_cast<char>(token.length & 0xFF));
+        payload.push_back(static_cast<char>(token.length >> 8));
+        payload.push_back(token.next_char);
+    }
+}
+
+// Decode a single block's serialized tokens. The raw size is known, so the
+// trailing padding character of the last token is dropped and literal NUL bytes survive.
+void decompressBlock(const char* payload, size_t payloadSize, size_t rawSize, std::vector<char>& data,
+                     TokenStats& tokenStats) {
+    data.resize(rawSize);
+    decodeTokens(payload, payloadSize, data.data(), rawSize, &tokenStats);
+}
+
+size_t compressBound(size_t size) {
+    return BUFFER_HEADER_SIZE + size;
+}
+
+size_t compressBuffer(const char* source, size_t sourceSize, char* destination, size_t destinationCapacity,
+                      const LZ77Settings& settings) {
+    if (destinationCapacity < BUFFER_HEADER_SIZE) {
+        throw std::length_error("Destination buffer is too small.");
+    }
+
+    // Tokens are written straight into the destination. Once they would outgrow
+    // the input, the data is stored instead, which keeps within compressBound.
+    char* payload = destination + BUFFER_HEADER_SIZE;
+    size_t payloadCapacity = std::min(destinationCapacity - BUFFER_HEADER_SIZE, sourceSize);
+    size_t payloadSize = 0;
+    bool fits = findTokens(source, sourceSize, settings, [&](const Token& token) {
+        if (payloadSize + TOKEN_SIZE > payloadCapacity) {
+            return false;
+        }
+        writeToken(token, payload + payloadSize);
+        payloadSize += TOKEN_SIZE;
+        return true;
+    });
+
+    BlockCodec codec = BlockCodec::LZ77;
+    if (!fits) {
+        if (destinationCapacity - BUFFER_HEADER_SIZE < sourceSize) {
+            throw std::length_error("Destination buffer is too small.");
+        }
+        codec = BlockCodec::Stored;
+        std::copy(source, source + sourceSize, payload);
+        payloadSize = sourceSize;
+    }
+
+    // Write header: codec and raw size
+    destination[0] = static_cast<char>(codec);
+    for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+        destination[1 + i] = static_cast<char>((static_cast<uint64_t>(sourceSize) >> (8 * i)) & 0xFF);
+    }
+    return BUFFER_HEADER_SIZE + payloadSize;
+}
+
+size_t decompressBound(const char* source, size_t sourceSize) {
+    if (sourceSize < BUFFER_HEADER_SIZE) {
+        throw std::runtime_error("Compressed buffer is truncated.");
+    }
+    uint64_t rawSize = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+        rawSize |= static_cast<uint64_t>(static_cast<uint8_t>(source[1 + i])) << (8 * i);
+    }
+    return static_cast<size_t>(rawSize);
+}
+
+size_t decompressBuffer(const char* source, size_t sourceSize, char* destination, size_t destinationCapacity) {
+    size_t rawSize = decompressBound(source, sourceSize);
+    if (rawSize > destinationCapacity) {
+        throw std::length_error("Destination buffer is too small.");
+    }
+
+    const char* payload = source + BUFFER_HEADER_SIZE;
+    size_t payloadSize = sourceSize - BUFFER_HEADER_SIZE;
+    BlockCodec codec = static_cast<BlockCodec>(source[0]);
+    if (codec == BlockCodec::LZ77 && payloadSize % TOKEN_SIZE == 0) {
+        decodeTokens(payload, payloadSize, destination, rawSize, nullptr);
+    } else if (codec == BlockCodec::Stored && payloadSize == rawSize) {
+        std::copy(payload, payload + payloadSize, destination);
+    } else {
+        throw std::runtime_error("Invalid or corrupt compressed buffer.");
+    }
+    return rawSize;
+}
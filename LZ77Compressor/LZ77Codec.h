@@ -0,0 +1,95 @@
+#ifndef LZ77CODEC_H
+#define LZ77CODEC_H
+
+#include "ArchiveFormat.h"
+#include "JobProgress.h"
+#include "JobStats.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Match finder settings. Archives are written with the defaults; the decoder
+// handles any window up to the 16-bit offset limit.
+struct LZ77Settings {
+    int windowSize = 4096;
+    int maxMatchLength = 18;
+};
+
+// Settings for a compression level from 1 (fastest) to 9 (smallest); level 4 is the default
+LZ77Settings settingsForLevel(int level);
+
+// Bytes of a file that auto-tuning compresses with each candidate; candidate windows
+// are no larger, so the sample exercises all of each window
+const size_t TUNING_SAMPLE_SIZE = 16 * 1024;
+
+// Pick match finder settings for data like sample by compressing it with a few
+// candidates. With a targetThroughput (bytes per second of one thread), the best
+// ratio among candidates at least that fast wins, or the fastest if none is;
+// without one, the best ratio per CPU-second. Candidates are timed on the calling
+// thread's CPU clock, so the choice, and the output compressed with it, can differ
+// between runs and machines.
+LZ77Settings tuneSettings(const char* sample, size_t size, double targetThroughput = 0);
+
+// Tokenize a block with the sliding-window match finder, which tries the offsets of
+// the last REPEAT_OFFSETS matches before the window. A triggered cancel
+// token is noticed every few thousand tokens and throws JobCancelled. Returns
+// false, with maxTokens tokens, if the block needs more than that.
+bool compressData(const char* data, size_t size, std::vector<Token>& tokens,
+                  const LZ77Settings& settings = LZ77Settings(), const CancellationToken* cancel = nullptr,
+                  size_t maxTokens = SIZE_MAX);
+
+// Append tokens to a payload in their 5-byte little-endian archive form
+void serializeTokens(const std::vector<Token>& tokens, std::vector<char>& payload);
+
+// Decode serialized tokens into exactly rawSize bytes at out. Throws std::runtime_error
+// if they don't add up to rawSize or reach back before the start of the block.
+void decodeTokens(const char* payload, size_t payloadSize, char* out, size_t rawSize, TokenStats* tokenStats);
+
+// Repeat-offset token payload, which the lz77 codec writes: a varint token count, then
+// for each token a tag byte whose top three bits give the offset, 0 for no match, 1 to
+// REPEAT_OFFSETS for one of the last distinct offsets matched, most recent first, or
+// TAG_OFFSET for a 16-bit offset after the tag. Its low five bits are the length minus
+// one, or LONG_LENGTH for a varint of the length minus 32 after the tag. The next
+// character comes last, except after a match that ends the block.
+const size_t REPEAT_OFFSETS = 4;
+const uint8_t TAG_OFFSET = REPEAT_OFFSETS + 1;
+const uint8_t LONG_LENGTH = 31;
+
+// A tag and a character; a block with more tokens than its size over this is stored
+const size_t MIN_REPEAT_TOKEN_SIZE = 2;
+
+// Append tokens for rawSize bytes to a payload as repeat-offset tokens, adding them to tokenStats
+void serializeRepeatTokens(const std::vector<Token>& tokens, size_t rawSize, std::vector<char>& payload,
+                           TokenStats* tokenStats);
+
+// Decode repeat-offset tokens into exactly rawSize bytes at out. Throws std::runtime_error
+// if they are truncated, don't add up to rawSize or reach back before the start of the block.
+void decodeRepeatTokens(const char* payload, size_t payloadSize, char* out, size_t rawSize,
+                        TokenStats* tokenStats);
+
+// Decode a block's serialized tokens into exactly rawSize bytes
+void decompressBlock(const char* payload, size_t payloadSize, size_t rawSize, std::vector<char>& data,
+                     TokenStats& tokenStats);
+
+// In-memory API for compressing caller-owned buffers. A compressed buffer is a
+// codec byte and the 64-bit raw size, followed by tokens or the raw bytes.
+// These functions never allocate: the match finder keeps no tables, and tokens
+// are written straight into the destination. They are safe to call concurrently.
+const size_t BUFFER_HEADER_SIZE = 1 + sizeof(uint64_t);
+
+// Largest possible compressed size of sourceSize bytes
+size_t compressBound(size_t size);
+
+// Compress into destination and return the bytes written. Throws std::length_error
+// if destinationCapacity is below what this input needs; compressBound() is always enough.
+size_t compressBuffer(const char* source, size_t sourceSize, char* destination, size_t destinationCapacity,
+                      const LZ77Settings& settings = LZ77Settings());
+
+// Size a compressed buffer restores to, read from its header
+size_t decompressBound(const char* source, size_t sourceSize);
+
+// Decompress into destination and return the bytes written. Throws std::length_error
+// if the destination is too small and std::runtime_error if the input is corrupt.
+size_t decompressBuffer(const char* source, size_t sourceSize, char* destination, size_t destinationCapacity);
+
+#endif // LZ77CODEC_H
@@ -0,0 +1,979 @@
+// Round-trip, compatibility and corruption tests for the archive engine.
+//
+// Usage: lz77_tests [group]...
+//
+// Runs the named test groups, or all of them: codecs, filters, archives, compat, resume,
+// corruption and streams. Archives and extracted trees go to a scratch directory under the
+// system temporary directory. The repository's testdata fixtures and the files and
+// executables corpora are found through LZ77_TEST_DATA and LZ77_CORPUS. Exits with 1 if
+// any check fails.
+
+#include "ArchiveCompressor.h"
+#include "ArchiveExtractor.h"
+#include "Checkpoint.h"
+#include "CodecRegistry.h"
+#include "Filters.h"
+#include "LZ77Codec.h"
+#include "SimdKernels.h"
+#include "StreamFrame.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct TestInput {
+    std::string name;
+    std::vector<char> data;
+};
+
+// A block of a hand-built archive: stored data, or a duplicate of the block at reference.
+// rawSize, when set, is the restored size claimed instead of the data's own.
+struct CraftedBlock {
+    BlockCodec codec;
+    std::string data;
+    size_t reference = 0;
+    uint64_t rawSize = 0;
+};
+
+struct TestGroup {
+    const char* name;
+    void (*run)();
+};
+
+// Failed checks so far, over every group
+static int failures = 0;
+
+// This program, a real executable for the x86 filter
+static fs::path testExecutable;
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+// Passes if statement throws std::runtime_error; any other exception escapes and fails the group
+#define CHECK_THROWS(statement)                                  \
+    do {                                                         \
+        bool thrown = false;                                     \
+        try {                                                    \
+            statement;                                           \
+        } catch (const std::runtime_error&) {                    \
+            thrown = true;                                       \
+        }                                                        \
+        check(thrown, #statement " throws", __FILE__, __LINE__); \
+    } while (0)
+
+// Function prototypes
+void check(bool passed, const char* expression, const char* file, int line);
+void testCodecs();
+void testFilters();
+void testArchives();
+void testCompat();
+void testResume();
+void testCorruption();
+void testStreams();
+std::vector<TestInput> syntheticInputs();
+std::vector<TestInput> corpusInputs(const fs::path& directory);
+std::vector<char> textData(size_t size, uint32_t seed);
+std::vector<char> randomData(size_t size, uint32_t seed);
+std::vector<char> readFile(const fs::path& path);
+void writeFile(const fs::path& path, const std::vector<char>& data);
+fs::path scratchDirectory(const std::string& name);
+void makeTestTree(const fs::path& root);
+bool sameTree(const fs::path& expected, const fs::path& actual);
+std::vector<uint64_t> contentHashes(const fs::path& root);
+bool roundTripCodec(const Codec& codec, const std::vector<char>& data, const LZ77Settings& settings);
+bool roundTripFilters(const FilterChain& filters, const std::vector<char>& data);
+std::vector<char> craftedArchive(const std::vector<CraftedBlock>& blocks);
+JobStats extractTo(const fs::path& archive, const fs::path& outputPath, size_t threads, bool resume = false);
+
+const TestGroup TEST_GROUPS[] = {
+    { "codecs", testCodecs },
+    { "filters", testFilters },
+    { "archives", testArchives },
+    { "compat", testCompat },
+    { "resume", testResume },
+    { "corruption", testCorruption },
+    { "streams", testStreams },
+};
+
+int main(int argc, char** argv) {
+    testExecutable = fs::absolute(argv[0]);
+    std::vector<const TestGroup*> groups;
+    for (int i = 1; i < argc; ++i) {
+        auto it = std::find_if(std::begin(TEST_GROUPS), std::end(TEST_GROUPS),
+                               [&](const TestGroup& group) { return std::strcmp(group.name, argv[i]) == 0; });
+        if (it == std::end(TEST_GROUPS)) {
+            std::cerr << "Unknown test group: " << argv[i] << std::endl;
+            return 1;
+        }
+        groups.push_back(&*it);
+    }
+    if (groups.empty()) {
+        for (const auto& group : TEST_GROUPS) {
+            groups.push_back(&group);
+        }
+    }
+
+    for (const TestGroup* group : groups) {
+        int failuresBefore = failures;
+        auto start = std::chrono::steady_clock::now();
+        try {
+            group->run();
+        } catch (const std::exception& e) {
+            std::cerr << group->name << ": unexpected exception: " << e.what() << std::endl;
+            ++failures;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%-12s %s (%.2f s)\n", group->name, failures == failuresBefore ? "passed" : "FAILED", seconds);
+        std::fflush(stdout);
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+void check(bool passed, const char* expression, const char* file, int line) {
+    if (!passed) {
+        ++failures;
+        std::cerr << file << ":" << line << ": check failed: " << expression << std::endl;
+    }
+}
+
+// Every codec at the fastest, default and smallest levels and every SIMD level, on the
+// match finder's extremes and real files, then corrupted and truncated payloads, which
+// must decode to something or throw but never read or write out of bounds
+void testCodecs() {
+    std::vector<TestInput> inputs = syntheticInputs();
+    size_t syntheticCount = inputs.size();
+    for (const char* corpus : { "files", "executables" }) {
+        for (auto& input : corpusInputs(fs::path(LZ77_CORPUS) / corpus)) {
+            inputs.push_back(std::move(input));
+        }
+    }
+
+    // The corpora at the default level only, which keeps unoptimized builds quick
+    for (const Codec* codec : registeredCodecs()) {
+        for (size_t index = 0; index < inputs.size(); ++index) {
+            for (int level : { MIN_COMPRESSION_LEVEL, DEFAULT_COMPRESSION_LEVEL, MAX_COMPRESSION_LEVEL }) {
+                if (index >= syntheticCount && level != DEFAULT_COMPRESSION_LEVEL) {
+                    continue;
+                }
+                if (!roundTripCodec(*codec, inputs[index].data, settingsForLevel(level))) {
+                    std::cerr << "  " << codec->name() << " level " << level << " on " << inputs[index].name << std::endl;
+                }
+            }
+        }
+    }
+
+    std::vector<char> text = textData(256 * 1024, 7);
+    for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512 }) {
+        if (setSimdLevel(level) != level) {
+            continue;
+        }
+        for (const Codec* codec : registeredCodecs()) {
+            CHECK(roundTripCodec(*codec, text, settingsForLevel(MAX_COMPRESSION_LEVEL)));
+        }
+    }
+    setSimdLevel(detectedSimdLevel());
+
+    std::mt19937 random(99);
+    std::vector<char> sample = textData(64 * 1024, 3);
+    std::vector<char> decoded(sample.size());
+    TokenStats tokenStats;
+    for (const Codec* codec : registeredCodecs()) {
+        CodecWorkspace workspace;
+        std::vector<char> payload;
+        if (!codec->compress(sample.data(), sample.size(), LZ77Settings(), workspace, payload)) {
+            continue;
+        }
+        for (size_t cut = 0; cut < payload.size(); cut += 1 + payload.size() / 64) {
+            try {
+                codec->decompress(payload.data(), cut, decoded.data(), decoded.size(), &tokenStats);
+            } catch (const std::runtime_error&) {
+            }
+        }
+        for (int flip = 0; flip < 256; ++flip) {
+            std::vector<char> corrupt = payload;
+            corrupt[random() % corrupt.size()] ^= static_cast<char>(1 + random() % 255);
+            try {
+                codec->decompress(corrupt.data(), corrupt.size(), decoded.data(), decoded.size(), &tokenStats);
+            } catch (const std::runtime_error&) {
+            }
+        }
+
+        // Tokens after the block is complete are corruption, not padding
+        if (codec->id() == BlockCodec::LZ77 || codec->id() == BlockCodec::LZ77Repeat) {
+            std::vector<char> trailing = payload;
+            trailing.insert(trailing.end(), { 1, 0, 0, 0, 'x' });
+            CHECK_THROWS(codec->decompress(trailing.data(), trailing.size(), decoded.data(), decoded.size(), &tokenStats));
+        }
+    }
+
+    // The in-memory buffer API
+    for (const auto& input : syntheticInputs()) {
+        std::vector<char> compressed(compressBound(input.data.size()));
+        size_t compressedSize = compressBuffer(input.data.data(), input.data.size(), compressed.data(), compressed.size());
+        CHECK(decompressBound(compressed.data(), compressedSize) == input.data.size());
+        std::vector<char> restored(input.data.size());
+        CHECK(decompressBuffer(compressed.data(), compressedSize, restored.data(), restored.size()) == input.data.size());
+        CHECK(restored == input.data);
+        if (compressedSize > BUFFER_HEADER_SIZE) {
+            CHECK_THROWS(decompressBuffer(compressed.data(), compressedSize - 1, restored.data(), restored.size()));
+        }
+    }
+}
+
+// Every filter on its own and chained, over sizes around each filter's period
+void testFilters() {
+    std::vector<FilterChain> chains;
+    for (const char* text : { "delta:1", "delta:2", "delta:4", "delta:256", "records:2", "records:3", "records:12",
+                              "records:65535" }) {
+        chains.push_back({ parseFilter(text) });
+    }
+    chains.push_back({ parseFilter("x86") });
+    chains.push_back({ parseFilter("x86"), parseFilter("delta:1") });
+    chains.push_back({ parseFilter("delta:4"), parseFilter("records:4") });
+    chains.push_back({ parseFilter("records:3"), parseFilter("delta:1"), parseFilter("delta:2"), parseFilter("records:7") });
+
+    std::vector<TestInput> inputs = syntheticInputs();
+    for (size_t size = 0; size < 40; ++size) {
+        inputs.push_back({ "random/" + std::to_string(size), randomData(size, static_cast<uint32_t>(size)) });
+    }
+    inputs.push_back({ "random/block", randomData(BLOCK_SIZE, 5) });
+
+    // A rejected opcode whose top byte a later operand rewrites, then random runs of opcodes,
+    // near-displacement bytes and real executables
+    inputs.push_back({ "x86/overlap", { '\xE8', '\x11', '\x22', '\xE8', '\xF8', '\x00', '\x00', '\x00' } });
+    std::mt19937 random(17);
+    const char opcodes[] = { '\xE8', '\xE9', '\x00', '\xFF' };
+    for (size_t size : { 16, 1000, 100000 }) {
+        TestInput input{ "x86/opcodes-" + std::to_string(size), randomData(size, static_cast<uint32_t>(size)) };
+        for (auto& byte : input.data) {
+            if (random() % 4 != 0) {
+                byte = opcodes[random() % 4];
+            }
+        }
+        inputs.push_back(std::move(input));
+    }
+    for (auto& input : corpusInputs(fs::path(LZ77_CORPUS) / "executables")) {
+        inputs.push_back(std::move(input));
+    }
+    inputs.push_back({ testExecutable.filename().string(), readFile(testExecutable) });
+
+    for (const auto& filters : chains) {
+        for (const auto& input : inputs) {
+            if (!roundTripFilters(filters, input.data)) {
+                std::cerr << "  " << filterChainName(filters) << " on " << input.name << std::endl;
+            }
+        }
+
+        std::stringstream header;
+        writeFilterChain(header, filters);
+        FilterChain read = readFilterChain(header);
+        CHECK(header && filterChainName(read) == filterChainName(filters));
+    }
+
+    for (const char* text : { "delta:0", "delta:257", "records:0", "records:1", "records:65536", "x86:2", "bogus", "delta:" }) {
+        CHECK_THROWS(parseFilter(text));
+    }
+    std::stringstream tooLong;
+    writeFilterChain(tooLong, FilterChain(MAX_FILTERS + 1, parseFilter("delta:1")));
+    readFilterChain(tooLong);
+    CHECK(!tooLong);
+}
+
+// Whole trees through every codec and a filter chain, extracted with one and with several threads
+void testArchives() {
+    fs::path scratch = scratchDirectory("archives");
+    fs::path tree = scratch / "in" / "tree";
+    makeTestTree(tree);
+
+    std::vector<std::pair<BlockCodec, FilterChain>> variants;
+    for (const Codec* codec : registeredCodecs()) {
+        variants.push_back({ codec->id(), FilterChain() });
+    }
+    variants.push_back({ BlockCodec::LZ77Repeat, { parseFilter("delta:2"), parseFilter("records:3") } });
+
+    for (const auto& variant : variants) {
+        CompressOptions options;
+        options.inputPath = tree.string();
+        options.outputFile = (scratch / "tree.arc").string();
+        options.codec = variant.first;
+        options.filters = variant.second;
+        options.threads = 4;
+        options.resume = false;
+        compressArchive(options);
+
+        std::vector<ArchiveEntry> entries = listArchive(options.outputFile);
+        bool hasLink = false;
+        bool hasDuplicates = false;
+        for (const auto& entry : entries) {
+            hasLink |= entry.type == EntryType::Link;
+            // Both are incompressible, so only duplicate blocks can make the later one small
+            hasDuplicates |= (entry.path == "tree/noise.bin" || entry.path == "tree/repeated.bin") &&
+                             entry.storedBytes < entry.size / 2;
+        }
+        CHECK(hasLink);
+        CHECK(hasDuplicates);
+        testArchive(options.outputFile);
+
+        for (size_t threads : { 1, 8 }) {
+            fs::path out = scratch / ("out-" + std::to_string(threads));
+            fs::remove_all(out);
+            extractTo(options.outputFile, out, threads);
+            if (!sameTree(tree, out / "tree")) {
+                std::cerr << "  codec " << static_cast<int>(variant.first) << " with " << threads << " threads"
+                          << std::endl;
+                CHECK(false);
+            }
+        }
+    }
+
+    // The text corpus, then the executables and this program through the x86 filter
+    fs::path executables = scratch / "executables";
+    fs::copy(fs::path(LZ77_CORPUS) / "executables", executables);
+    fs::copy_file(testExecutable, executables / testExecutable.filename());
+    CompressOptions options;
+    options.outputFile = (scratch / "corpus.arc").string();
+    options.resume = false;
+    for (const fs::path& corpus : { fs::path(LZ77_CORPUS) / "files", executables }) {
+        options.inputPath = corpus.string();
+        if (corpus == executables) {
+            options.filters = { parseFilter("x86") };
+        }
+        compressArchive(options);
+        testArchive(options.outputFile);
+        fs::path out = scratch / ("out-" + corpus.filename().string());
+        extractTo(options.outputFile, out, 4);
+        CHECK(sameTree(corpus, out / corpus.filename()));
+    }
+    fs::remove_all(scratch);
+}
+
+// Archives written by every earlier format version. v1-tokens.arc has the original
+// file entries of 5-byte tokens; v1.arc to v4.arc hold the same files, one as a link.
+void testCompat() {
+    fs::path scratch = scratchDirectory("compat");
+    fs::path files = fs::path(LZ77_CORPUS) / "files";
+    const std::map<std::string, std::string> originals = {
+        { "compat/70-1file.txt", "70-1file.txt" },
+        { "compat/basic_text_file.txt", "basic_text_file.txt" },
+        { "compat/234.txt", "234.txt" },
+        { "compat/sub/copy.txt", "234.txt" },
+    };
+
+    for (const char* name : { "v1-tokens", "v1", "v2", "v3", "v4" }) {
+        fs::path archive = fs::path(LZ77_TEST_DATA) / (std::string(name) + ".arc");
+        std::vector<ArchiveEntry> entries = listArchive(archive.string());
+        CHECK(!entries.empty());
+        testArchive(archive.string());
+
+        fs::path out = scratch / name;
+        extractTo(archive, out, 2);
+        size_t restored = 0;
+        for (const auto& entry : entries) {
+            if (entry.type == EntryType::Directory) {
+                CHECK(fs::is_directory(out / entry.path));
+                continue;
+            }
+            auto original = originals.find(entry.path);
+            CHECK(original != originals.end());
+            if (original != originals.end()) {
+                CHECK(readFile(out / entry.path) == readFile(files / original->second));
+                ++restored;
+            }
+        }
+        CHECK(restored == (std::string(name) == "v1-tokens" ? 2u : 4u));
+    }
+    fs::remove_all(scratch);
+}
+
+// Interrupted compression and extraction picked up by a second run
+void testResume() {
+    fs::path scratch = scratchDirectory("resume");
+    fs::path tree = scratch / "in" / "tree";
+    for (uint32_t file = 0; file < 6; ++file) {
+        writeFile(tree / ("part" + std::to_string(file) + ".txt"), textData(BLOCK_SIZE + 1000 * file, 20 + file));
+    }
+    writeFile(tree / "copy.txt", readFile(tree / "part2.txt"));
+
+    CompressOptions options;
+    options.inputPath = tree.string();
+    options.threads = 1;
+    options.resume = false;
+    options.outputFile = (scratch / "whole.arc").string();
+    compressArchive(options);
+
+    // Cancel once part of the archive is written, then resume into the same file
+    options.resume = true;
+    options.outputFile = (scratch / "resumed.arc").string();
+    CancellationToken cancel;
+    bool cancelled = false;
+    try {
+        compressArchive(options, [&](int percentage) {
+            if (percentage >= 20) {
+                cancel.cancel();
+            }
+        }, &cancel);
+    } catch (const JobCancelled&) {
+        cancelled = true;
+    }
+    CHECK(cancelled);
+    CHECK(fs::exists(checkpointPath(options.outputFile)));
+    JobStats stats = compressArchive(options);
+    CHECK(stats.resumedEntries > 0);
+    CHECK(readFile(options.outputFile) == readFile(scratch / "whole.arc"));
+    CHECK(!fs::exists(checkpointPath(options.outputFile)));
+
+    // An update whose first file is copied from a base archive written with other filters:
+    // the rest repeat its leading blocks, which must still be compressed afresh after a resume
+    fs::path updateTree = scratch / "update" / "tree";
+    std::vector<fs::path> updateFiles;
+    for (int file = 0; file < 9; ++file) {
+        updateFiles.push_back(updateTree / ("f" + std::to_string(file) + ".txt"));
+        writeFile(updateFiles.back(), {});
+    }
+    // The compressor takes them in directory order, whichever that is
+    std::vector<fs::path> order;
+    for (const auto& entry : fs::directory_iterator(updateTree)) {
+        order.push_back(entry.path());
+    }
+    std::vector<char> shared = textData(2 * BLOCK_SIZE, 30);
+    writeFile(order[0], shared);
+    for (uint32_t file = 1; file < order.size(); ++file) {
+        std::vector<char> data = shared;
+        std::vector<char> tail = textData(BLOCK_SIZE / 2, 30 + file);
+        data.insert(data.end(), tail.begin(), tail.end());
+        writeFile(order[file], data);
+    }
+
+    CompressOptions update;
+    update.inputPath = updateTree.string();
+    update.outputFile = (scratch / "base.arc").string();
+    update.filters = { parseFilter("delta:2") };
+    update.resume = false;
+    compressArchive(update);
+
+    update.baseArchive = update.outputFile;
+    update.filters.clear();
+    update.threads = 1;
+    update.outputFile = (scratch / "update-whole.arc").string();
+    compressArchive(update);
+
+    update.resume = true;
+    update.outputFile = (scratch / "update-resumed.arc").string();
+    CancellationToken cancelUpdate;
+    cancelled = false;
+    try {
+        compressArchive(update, [&](int percentage) {
+            if (percentage >= 40) {
+                cancelUpdate.cancel();
+            }
+        }, &cancelUpdate);
+    } catch (const JobCancelled&) {
+        cancelled = true;
+    }
+    CHECK(cancelled);
+    stats = compressArchive(update);
+    CHECK(stats.resumedEntries > 1);
+    CHECK(readFile(update.outputFile) == readFile(scratch / "update-whole.arc"));
+    testArchive(update.outputFile);
+
+    // A directory where one of the files goes stops extraction after the entries before it
+    fs::path out = scratch / "out";
+    fs::path blocker = out / "tree" / "part3.txt";
+    fs::create_directories(blocker);
+    writeFile(blocker / "in-the-way", { 'x' });
+    CHECK_THROWS(extractTo(options.outputFile, out, 4, true));
+    fs::remove_all(blocker);
+    stats = extractTo(options.outputFile, out, 4, true);
+    CHECK(stats.resumedEntries > 0);
+    CHECK(sameTree(tree, out / "tree"));
+    fs::remove_all(scratch);
+}
+
+// Truncated and bit-flipped archives and stream frames are rejected, or, where the format
+// can't tell (a cut between entries, a changed name or time), restore only intact data
+void testCorruption() {
+    fs::path scratch = scratchDirectory("corruption");
+    fs::path tree = scratch / "in" / "tree";
+    writeFile(tree / "large.txt", textData(BLOCK_SIZE + BLOCK_SIZE / 2, 41));
+    writeFile(tree / "small.txt", textData(3000, 42));
+    writeFile(tree / "noise.bin", randomData(5000, 43));
+    writeFile(tree / "large-noise.bin", randomData(300 * 1024, 44));
+    writeFile(tree / "sub" / "copy.txt", textData(3000, 42));
+
+    CompressOptions options;
+    options.inputPath = tree.string();
+    options.outputFile = (scratch / "good.arc").string();
+    options.resume = false;
+    compressArchive(options);
+    std::vector<char> archive = readFile(options.outputFile);
+    size_t entryCount = listArchive(options.outputFile).size();
+    std::vector<uint64_t> expectedHashes = contentHashes(tree);
+
+    fs::path corruptFile = scratch / "corrupt.arc";
+    for (size_t cut = 0; cut < archive.size(); cut += 1 + archive.size() / 97) {
+        writeFile(corruptFile, std::vector<char>(archive.begin(), archive.begin() + cut));
+        try {
+            testArchive(corruptFile.string());
+            CHECK(listArchive(corruptFile.string()).size() < entryCount);
+        } catch (const std::runtime_error&) {
+        }
+    }
+
+    std::mt19937 random(1234);
+    for (int flip = 0; flip < 200; ++flip) {
+        std::vector<char> corrupt = archive;
+        corrupt[random() % corrupt.size()] ^= static_cast<char>(1 + random() % 255);
+        writeFile(corruptFile, corrupt);
+        try {
+            testArchive(corruptFile.string());
+        } catch (const std::runtime_error&) {
+            continue;
+        }
+        fs::path out = scratch / "out";
+        fs::remove_all(out);
+        try {
+            extractTo(corruptFile, out, 2);
+        } catch (const std::runtime_error&) {
+            continue;
+        }
+        CHECK(contentHashes(out) == expectedHashes);
+    }
+
+    // Stored blocks decode whatever they hold, so only the content hash catches a flipped byte
+    // in one; extraction checks it on its own, for files decoded in memory and in place
+    for (const char* name : { "noise.bin", "large-noise.bin" }) {
+        std::vector<char> data = readFile(tree / name);
+        auto stored = std::search(archive.begin(), archive.end(), data.begin() + 1000, data.begin() + 1032);
+        CHECK(stored != archive.end());
+        if (stored == archive.end()) {
+            continue;
+        }
+        std::vector<char> corrupt = archive;
+        corrupt[stored - archive.begin()] ^= 1;
+        writeFile(corruptFile, corrupt);
+        fs::path out = scratch / "flipped";
+        fs::remove_all(out);
+        CHECK_THROWS(extractTo(corruptFile, out, 2));
+        CHECK(!fs::exists(out / "tree" / name));
+    }
+
+    // Duplicates may only repeat an earlier block with a codec and the same size
+    writeFile(corruptFile, craftedArchive({ { BlockCodec::Stored, "hello" }, { BlockCodec::Duplicate, "hello", 0 } }));
+    testArchive(corruptFile.string());
+    extractTo(corruptFile, scratch / "crafted", 1);
+    CHECK(readFile(scratch / "crafted" / "crafted.txt") == std::vector<char>({ 'h', 'e', 'l', 'l', 'o', 'h', 'e', 'l', 'l', 'o' }));
+
+    const std::vector<std::vector<CraftedBlock>> invalidReferences = {
+        { { BlockCodec::Duplicate, "hello", 1 }, { BlockCodec::Stored, "hello" } },
+        { { BlockCodec::Stored, "hello" }, { BlockCodec::Duplicate, "hello", 1 } },
+        { { BlockCodec::Stored, "hello" }, { BlockCodec::Duplicate, "hello", 0 }, { BlockCodec::Duplicate, "hello", 1 } },
+        { { BlockCodec::Stored, "hello" }, { BlockCodec::Duplicate, "hello!", 0 } },
+    };
+    for (const auto& blocks : invalidReferences) {
+        writeFile(corruptFile, craftedArchive(blocks));
+        CHECK_THROWS(testArchive(corruptFile.string()));
+        CHECK_THROWS(extractTo(corruptFile, scratch / "crafted", 1));
+    }
+
+    // Block sizes are bounded before anything is allocated for them, and token payloads must
+    // be able to restore their block
+    const std::string token("\x01\0\0\0x", TOKEN_SIZE);
+    const std::vector<std::vector<CraftedBlock>> invalidSizes = {
+        { { BlockCodec::Stored, "" } },
+        { { BlockCodec::LZ77, "", 0, UINT32_MAX } },
+        { { BlockCodec::LZ77, token, 0, MAX_BLOCK_SIZE + 1 } },
+    };
+    for (const auto& blocks : invalidSizes) {
+        writeFile(corruptFile, craftedArchive(blocks));
+        CHECK_THROWS(listArchive(corruptFile.string()));
+        CHECK_THROWS(extractTo(corruptFile, scratch / "crafted", 8));
+    }
+    const std::vector<std::vector<CraftedBlock>> invalidPayloads = {
+        { { BlockCodec::LZ77, "", 0, MAX_BLOCK_SIZE } },
+        { { BlockCodec::LZ77, token, 0, UINT16_MAX + 2 } },
+        { { BlockCodec::LZ77, token + token, 0, 1 } },
+    };
+    for (const auto& blocks : invalidPayloads) {
+        writeFile(corruptFile, craftedArchive(blocks));
+        CHECK_THROWS(testArchive(corruptFile.string()));
+        CHECK_THROWS(extractTo(corruptFile, scratch / "crafted", 8));
+    }
+
+    // A file decoded in place is removed when one of its blocks fails
+    writeFile(corruptFile, craftedArchive({ { BlockCodec::Stored, std::string(BLOCK_SIZE, 'a') },
+                                            { BlockCodec::LZ77, token, 0, 2 } }));
+    fs::remove_all(scratch / "crafted");
+    CHECK_THROWS(extractTo(corruptFile, scratch / "crafted", 2));
+    CHECK(!fs::exists(scratch / "crafted" / "crafted.txt"));
+
+    // Links may only copy a file restored earlier from the same archive, and must match it
+    const std::string content = "hellohello";
+    auto withLink = [&](const std::string& path, const std::string& target, uint64_t size, uint64_t hash) {
+        std::vector<char> bytes = craftedArchive({ { BlockCodec::Stored, "hello" }, { BlockCodec::Stored, "hello" } });
+        std::ostringstream link;
+        link.put(static_cast<char>(EntryType::Link));
+        writeVarUInt(link, path.size());
+        link << path;
+        writeUInt64(link, size);
+        writeUInt64(link, 0);
+        writeUInt64(link, hash);
+        writeVarUInt(link, target.size());
+        link << target;
+        std::string entry = link.str();
+        bytes.insert(bytes.end(), entry.begin(), entry.end());
+        return bytes;
+    };
+    const uint64_t contentHash = hashData(content.data(), content.size());
+    writeFile(corruptFile, withLink("link.txt", "crafted.txt", content.size(), contentHash));
+    testArchive(corruptFile.string());
+    fs::remove_all(scratch / "linked");
+    extractTo(corruptFile, scratch / "linked", 1);
+    CHECK(readFile(scratch / "linked" / "link.txt") == std::vector<char>(content.begin(), content.end()));
+
+    writeFile(scratch / "outside.txt", std::vector<char>(content.begin(), content.end()));
+    const std::vector<std::vector<char>> invalidLinks = {
+        withLink("link.txt", "/etc/passwd", content.size(), contentHash),
+        withLink("link.txt", "../outside.txt", content.size(), contentHash),
+        withLink("link.txt", "missing.txt", content.size(), contentHash),
+        withLink("link.txt", "crafted.txt", content.size(), contentHash + 1),
+        withLink("link.txt", "crafted.txt", content.size() + 1, contentHash),
+        withLink("../link.txt", "crafted.txt", content.size(), contentHash),
+    };
+    for (const auto& bytes : invalidLinks) {
+        writeFile(corruptFile, bytes);
+        CHECK_THROWS(testArchive(corruptFile.string()));
+        fs::remove_all(scratch / "linked");
+        CHECK_THROWS(extractTo(corruptFile, scratch / "linked", 1));
+        CHECK(!fs::exists(scratch / "linked" / "link.txt") && !fs::exists(scratch / "link.txt"));
+    }
+
+    // Token counts beyond the end of the file, in the original format and in the current one
+    std::ostringstream legacy;
+    legacy << "MYARCH";
+    legacy.put(static_cast<char>(EntryType::File));
+    writeUInt16(legacy, 5);
+    legacy << "a.txt";
+    writeUInt32(legacy, UINT32_MAX);
+    legacy << std::string(10, 'x');
+    std::ostringstream current;
+    writeArchiveHeader(current);
+    current.put(static_cast<char>(EntryType::File));
+    writeVarUInt(current, 5);
+    current << "a.txt";
+    writeVarUInt(current, UINT64_MAX / TOKEN_SIZE + 2);
+    current << std::string(10, 'x');
+    for (const std::string& bytes : { legacy.str(), current.str() }) {
+        writeFile(corruptFile, std::vector<char>(bytes.begin(), bytes.end()));
+        CHECK_THROWS(listArchive(corruptFile.string()));
+        CHECK_THROWS(testArchive(corruptFile.string()));
+    }
+    fs::remove_all(scratch);
+}
+
+// Stream frames round-trip with every codec and reject truncation, trailing data and corruption
+void testStreams() {
+    std::vector<TestInput> inputs = syntheticInputs();
+    inputs.push_back({ "empty", {} });
+    inputs.push_back({ "text/multi-block", textData(2 * BLOCK_SIZE + 77, 8) });
+
+    for (const Codec* codec : registeredCodecs()) {
+        for (const auto& input : inputs) {
+            StreamOptions options;
+            options.codec = codec->id();
+            options.threads = 3;
+            if (input.name == "text/multi-block") {
+                options.filters = { parseFilter("delta:1") };
+            }
+            std::istringstream source(std::string(input.data.begin(), input.data.end()));
+            std::ostringstream frame;
+            compressStream(source, frame, options);
+            std::istringstream encoded(frame.str());
+            std::ostringstream decoded;
+            decompressStream(encoded, decoded, options);
+            CHECK(decoded.str() == std::string(input.data.begin(), input.data.end()));
+        }
+    }
+
+    std::vector<char> data = textData(20000, 9);
+    std::string original(data.begin(), data.end());
+    std::istringstream source(original);
+    std::ostringstream output;
+    compressStream(source, output);
+    const std::string frame = output.str();
+
+    for (size_t cut = 0; cut < frame.size(); ++cut) {
+        std::istringstream truncated(frame.substr(0, cut));
+        std::ostringstream decoded;
+        CHECK_THROWS(decompressStream(truncated, decoded));
+    }
+    std::istringstream trailing(frame + '\0');
+    std::ostringstream decoded;
+    CHECK_THROWS(decompressStream(trailing, decoded));
+
+    std::mt19937 random(77);
+    for (int flip = 0; flip < 500; ++flip) {
+        std::string corrupt = frame;
+        corrupt[random() % corrupt.size()] ^= static_cast<char>(1 + random() % 255);
+        std::istringstream input(corrupt);
+        std::ostringstream restored;
+        try {
+            decompressStream(input, restored);
+        } catch (const std::runtime_error&) {
+            continue;
+        }
+        CHECK(restored.str() == original);
+    }
+}
+
+// Inputs that cover the match finder's extremes: no matches, long runs and text-like repeats
+std::vector<TestInput> syntheticInputs() {
+    std::vector<TestInput> inputs;
+    inputs.push_back({ "synthetic/one-byte", { 'a' } });
+    inputs.push_back({ "synthetic/zeros", std::vector<char>(BLOCK_SIZE + 3, '\0') });
+    inputs.push_back({ "synthetic/random", randomData(300 * 1024, 1) });
+    inputs.push_back({ "synthetic/text", textData(BLOCK_SIZE / 3, 2) });
+
+    TestInput periodic{ "synthetic/periodic", std::vector<char>(200 * 1024) };
+    for (size_t i = 0; i < periodic.data.size(); ++i) {
+        periodic.data[i] = static_cast<char>((i * 7) % 251);
+    }
+    inputs.push_back(std::move(periodic));
+
+    std::mt19937 random(3);
+    TestInput runs{ "synthetic/runs", {} };
+    while (runs.data.size() < 200 * 1024) {
+        runs.data.insert(runs.data.end(), 1 + random() % 300, static_cast<char>(random() & 0xFF));
+    }
+    inputs.push_back(std::move(runs));
+    return inputs;
+}
+
+std::vector<TestInput> corpusInputs(const fs::path& directory) {
+    std::vector<fs::path> files;
+    for (const auto& entry : fs::directory_iterator(directory)) {
+        if (entry.is_regular_file()) {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    std::vector<TestInput> inputs;
+    for (const auto& file : files) {
+        inputs.push_back({ file.filename().string(), readFile(file) });
+    }
+    return inputs;
+}
+
+// Words drawn from a small vocabulary give short, frequent matches at varied offsets
+std::vector<char> textData(size_t size, uint32_t seed) {
+    const char* words[] = { "the ", "archive ", "block ", "token ", "window ", "match ", "offset ",
+                            "length ", "of ", "and ", "compress ", "data ", "file ", "a ", "in ", "\n" };
+    std::mt19937 random(seed);
+    std::vector<char> data;
+    while (data.size() < size) {
+        const char* word = words[random() % (sizeof(words) / sizeof(words[0]))];
+        data.insert(data.end(), word, word + std::strlen(word));
+    }
+    data.resize(size);
+    return data;
+}
+
+std::vector<char> randomData(size_t size, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::vector<char> data(size);
+    for (auto& byte : data) {
+        byte = static_cast<char>(random() & 0xFF);
+    }
+    return data;
+}
+
+std::vector<char> readFile(const fs::path& path) {
+    std::ifstream infile(path, std::ios::binary);
+    if (!infile) {
+        throw std::runtime_error("Failed to open test file: " + path.string());
+    }
+    return std::vector<char>(std::istreambuf_iterator<char>(infile), std::istreambuf_iterator<char>());
+}
+
+void writeFile(const fs::path& path, const std::vector<char>& data) {
+    fs::create_directories(path.parent_path());
+    std::ofstream outfile(path, std::ios::binary | std::ios::trunc);
+    outfile.write(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!outfile) {
+        throw std::runtime_error("Failed to write test file: " + path.string());
+    }
+}
+
+// An empty directory for one test group, left behind if the group fails
+fs::path scratchDirectory(const std::string& name) {
+    fs::path path = fs::temp_directory_path() / ("lz77_tests-" + name);
+    fs::remove_all(path);
+    fs::create_directories(path);
+    return path;
+}
+
+// Multi-block files that go through parallel block decoding, blocks repeated in another
+// file, a copy that becomes a link, incompressible data and empty files and directories
+void makeTestTree(const fs::path& root) {
+    std::vector<char> text = textData(3 * BLOCK_SIZE + 12345, 11);
+    writeFile(root / "text.txt", text);
+    writeFile(root / "copy" / "text.txt", text);
+
+    // Chunks end where the content says, so a long shared prefix shares its leading blocks
+    std::vector<char> noise = randomData(4 * BLOCK_SIZE, 13);
+    writeFile(root / "noise.bin", noise);
+    std::vector<char> repeated(noise.begin(), noise.begin() + 3 * BLOCK_SIZE + BLOCK_SIZE / 2);
+    std::vector<char> tail = textData(4000, 12);
+    repeated.insert(repeated.end(), tail.begin(), tail.end());
+    writeFile(root / "repeated.bin", repeated);
+    writeFile(root / "small" / "a.txt", textData(4000, 14));
+    writeFile(root / "small" / "b.txt", { 'b' });
+    writeFile(root / "empty.txt", {});
+    fs::create_directories(root / "empty" / "nested");
+}
+
+// Same directories and files with the same contents
+bool sameTree(const fs::path& expected, const fs::path& actual) {
+    auto listing = [](const fs::path& root) {
+        std::vector<std::string> paths;
+        for (const auto& entry : fs::recursive_directory_iterator(root)) {
+            paths.push_back(fs::relative(entry.path(), root).generic_string() + (entry.is_directory() ? "/" : ""));
+        }
+        std::sort(paths.begin(), paths.end());
+        return paths;
+    };
+
+    if (!fs::is_directory(actual)) {
+        return false;
+    }
+    std::vector<std::string> paths = listing(expected);
+    if (paths != listing(actual)) {
+        return false;
+    }
+    for (const auto& path : paths) {
+        if (path.back() != '/' && readFile(expected / path) != readFile(actual / path)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Sorted hashes of every file below root, which renaming leaves alone
+std::vector<uint64_t> contentHashes(const fs::path& root) {
+    std::vector<uint64_t> hashes;
+    if (fs::is_directory(root)) {
+        for (const auto& entry : fs::recursive_directory_iterator(root)) {
+            if (entry.is_regular_file()) {
+                std::vector<char> data = readFile(entry.path());
+                hashes.push_back(hashData(data.data(), data.size()));
+            }
+        }
+    }
+    std::sort(hashes.begin(), hashes.end());
+    return hashes;
+}
+
+// Compress data block by block as an archive would and check each block decodes back
+bool roundTripCodec(const Codec& codec, const std::vector<char>& data, const LZ77Settings& settings) {
+    CodecWorkspace workspace;
+    std::vector<char> payload;
+    std::vector<char> decoded;
+    TokenStats tokenStats;
+    bool passed = true;
+
+    for (size_t offset = 0; offset < data.size(); offset += BLOCK_SIZE) {
+        size_t blockSize = std::min(BLOCK_SIZE, data.size() - offset);
+        payload.clear();
+        if (!codec.compress(data.data() + offset, blockSize, settings, workspace, payload)) {
+            continue;
+        }
+        decoded.assign(blockSize, '\0');
+        bool sizesValid = payload.size() <= codec.bound(blockSize) && codec.validSizes(payload.size(), blockSize);
+        CHECK(sizesValid);
+        codec.decompress(payload.data(), payload.size(), decoded.data(), decoded.size(), &tokenStats);
+        bool same = std::equal(decoded.begin(), decoded.end(), data.begin() + offset);
+        CHECK(same);
+        passed = passed && sizesValid && same;
+    }
+    return passed;
+}
+
+bool roundTripFilters(const FilterChain& filters, const std::vector<char>& data) {
+    std::vector<char> filtered;
+    std::vector<char> scratch;
+    applyFilters(filters, data.data(), data.size(), filtered, scratch);
+    bool sameSize = filtered.size() == data.size();
+    reverseFilters(filters, filtered, scratch);
+    bool passed = sameSize && filtered == data;
+    CHECK(passed);
+    return passed;
+}
+
+// An archive holding crafted.txt made of blocks, laid out as the compressor writes them:
+// a duplicate's payload is the offset of the referenced block's header
+std::vector<char> craftedArchive(const std::vector<CraftedBlock>& blocks) {
+    std::ostringstream archive;
+    writeArchiveHeader(archive);
+    const std::string path = "crafted.txt";
+    archive.put(static_cast<char>(EntryType::BlockFile));
+    writeVarUInt(archive, path.size());
+    archive << path;
+
+    std::string content;
+    uint64_t fileSize = 0;
+    for (const auto& block : blocks) {
+        content += block.data;
+        fileSize += block.rawSize != 0 ? block.rawSize : block.data.size();
+    }
+    writeUInt64(archive, fileSize);
+    writeUInt64(archive, 0);
+    writeUInt64(archive, hashData(content.data(), content.size()));
+    writeVarUInt(archive, LZ77Settings().windowSize);
+    writeVarUInt(archive, LZ77Settings().maxMatchLength);
+    writeFilterChain(archive, FilterChain());
+    writeVarUInt(archive, blocks.size());
+
+    std::vector<uint64_t> headerOffsets;
+    uint64_t offset = static_cast<uint64_t>(archive.tellp());
+    for (const auto& block : blocks) {
+        size_t payloadSize = block.codec == BlockCodec::Duplicate ? sizeof(uint64_t) : block.data.size();
+        uint64_t rawSize = block.rawSize != 0 ? block.rawSize : block.data.size();
+        headerOffsets.push_back(offset);
+        offset += 1 + varUIntSize(rawSize) + varUIntSize(payloadSize) + payloadSize;
+    }
+    for (const auto& block : blocks) {
+        archive.put(static_cast<char>(block.codec));
+        writeVarUInt(archive, block.rawSize != 0 ? block.rawSize : block.data.size());
+        if (block.codec == BlockCodec::Duplicate) {
+            writeVarUInt(archive, sizeof(uint64_t));
+            writeUInt64(archive, headerOffsets[block.reference]);
+        } else {
+            writeVarUInt(archive, block.data.size());
+            archive << block.data;
+        }
+    }
+
+    std::string bytes = archive.str();
+    return std::vector<char>(bytes.begin(), bytes.end());
+}
+
+JobStats extractTo(const fs::path& archive, const fs::path& outputPath, size_t threads, bool resume) {
+    ExtractOptions options;
+    options.inputFile = archive.string();
+    options.outputPath = outputPath.string();
+    options.threads = threads;
+    options.resume = resume;
+    return extractArchive(options);
+}
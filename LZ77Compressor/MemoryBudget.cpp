@@ -0,0 +1,87 @@
+#include "MemoryBudget.h"
+#include "ArchiveFormat.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// Sizes used when no budget is given
+const size_t DEFAULT_IN_FLIGHT_BYTES = 256 * 1024 * 1024;
+const size_t DEFAULT_BATCH_BYTES = 4 * 1024 * 1024;
+const size_t DEFAULT_RETAINED_BYTES = 64 * 1024 * 1024;
+
+// Smallest batch of small files worth writing together
+const size_t MIN_BATCH_BYTES = 1024 * 1024;
+
+namespace {
+
+size_t resolveThreads(size_t threads) {
+    return threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+void requireBudget(size_t maxMemory, size_t minimum) {
+    if (maxMemory < minimum) {
+        throw std::runtime_error("The memory budget is too small; at least " +
+                                 std::to_string((minimum + 1024 * 1024 - 1) / (1024 * 1024)) + " MiB is needed.");
+    }
+}
+
+} // namespace
+
+CompressionPlan planCompression(size_t maxMemory, size_t threads, size_t scratchBytes) {
+    // Each compressor thread keeps its codec's scratch; the reader needs two blocks to
+    // find boundaries in a file it streams. Blocks waiting for the writer hold their
+    // payload besides their data, so in-flight bytes are counted twice.
+    const size_t threadBytes = std::max<size_t>(scratchBytes, 1);
+    const size_t chunkingBytes = 2 * MAX_BLOCK_SIZE;
+    const size_t minInFlightBytes = 2 * MAX_BLOCK_SIZE;
+
+    CompressionPlan plan;
+    plan.threads = resolveThreads(threads);
+    if (maxMemory == 0) {
+        plan.inFlightBytes = DEFAULT_IN_FLIGHT_BYTES;
+        plan.retainedBytes = DEFAULT_RETAINED_BYTES;
+    } else {
+        size_t fixedBytes = BASELINE_MEMORY + chunkingBytes + 2 * minInFlightBytes;
+        requireBudget(maxMemory, fixedBytes + threadBytes);
+
+        // Threads may take up to half of what is left; the rest goes to read-ahead
+        size_t spare = maxMemory - fixedBytes;
+        plan.threads = std::max<size_t>(1, std::min(plan.threads, spare / 2 / threadBytes));
+        spare -= plan.threads * threadBytes;
+        plan.retainedBytes = std::min(DEFAULT_RETAINED_BYTES, spare / 8);
+        spare -= plan.retainedBytes;
+        plan.inFlightBytes = std::min(DEFAULT_IN_FLIGHT_BYTES, minInFlightBytes + spare / 2);
+    }
+
+    // A batch and the file that tips it over stay within half the read-ahead
+    plan.streamFileSize = plan.inFlightBytes / 4;
+    plan.batchBytes = std::min(DEFAULT_BATCH_BYTES, plan.inFlightBytes / 4);
+    return plan;
+}
+
+ExtractionPlan planExtraction(size_t maxMemory, size_t threads, size_t scratchBytes) {
+    // Each decoding thread holds a payload, a decoded block and its codec's scratch;
+    // the calling thread keeps the same for small files, plus the batch waiting to be written
+    const size_t threadBytes = 2 * MAX_BLOCK_SIZE + scratchBytes;
+
+    ExtractionPlan plan;
+    plan.threads = resolveThreads(threads);
+    plan.blockBytes = MAX_BLOCK_SIZE;
+    if (maxMemory == 0) {
+        plan.batchBytes = DEFAULT_BATCH_BYTES;
+        plan.retainedBytes = DEFAULT_RETAINED_BYTES;
+        return plan;
+    }
+
+    size_t fixedBytes = BASELINE_MEMORY + threadBytes + MIN_BATCH_BYTES;
+    requireBudget(maxMemory, fixedBytes + threadBytes);
+
+    size_t spare = maxMemory - fixedBytes;
+    plan.threads = std::max<size_t>(1, std::min(plan.threads, spare / 2 / threadBytes));
+    spare -= plan.threads * threadBytes;
+    plan.retainedBytes = std::min(DEFAULT_RETAINED_BYTES, spare / 4);
+    spare -= plan.retainedBytes;
+    plan.batchBytes = std::min(DEFAULT_BATCH_BYTES, MIN_BATCH_BYTES + spare / 2);
+    return plan;
+}
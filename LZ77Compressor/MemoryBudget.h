@@ -0,0 +1,34 @@
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <cstddef>
+
+// Memory a job needs regardless of its buffers: code, runtime and bookkeeping
+const size_t BASELINE_MEMORY = 8 * 1024 * 1024;
+
+// How a compression job sizes its pipeline
+struct CompressionPlan {
+    size_t threads = 0;           // Compressor threads
+    size_t inFlightBytes = 0;     // File data read ahead of the writer
+    size_t streamFileSize = 0;    // Larger files are read block by block instead of whole
+    size_t batchBytes = 0;        // Small files are read in batches of up to this many bytes
+    size_t retainedBytes = 0;     // Idle buffers kept for reuse
+};
+
+// How an extraction job sizes its buffers
+struct ExtractionPlan {
+    size_t threads = 0;           // Block decoding threads for large files
+    size_t blockBytes = 0;        // Largest block, raw or compressed, a thread's buffers are sized for
+    size_t batchBytes = 0;        // Small files are written in batches of up to this many bytes
+    size_t retainedBytes = 0;     // Idle buffers kept for reuse
+};
+
+// Split maxMemory bytes between the stages of a job. threads is the requested
+// thread count (0 for one per hardware thread) and is lowered to fit; scratchBytes
+// is what each thread working on a block of MAX_BLOCK_SIZE needs besides the block
+// and its payload. A maxMemory of 0 leaves the job at its usual sizes. Throws
+// std::runtime_error if the budget is below what a single such thread needs.
+CompressionPlan planCompression(size_t maxMemory, size_t threads, size_t scratchBytes);
+ExtractionPlan planExtraction(size_t maxMemory, size_t threads, size_t scratchBytes);
+
+#endif // MEMORYBUDGET_H
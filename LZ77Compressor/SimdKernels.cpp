@@ -0,0 +1,297 @@
+#include "SimdKernels.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define LZ77_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang compile each level's kernels for its instruction set without raising
+// the rest of the program's; MSVC accepts the intrinsics anywhere
+#ifdef __GNUC__
+#define LZ77_TARGET(isa) __attribute__((target(isa)))
+#else
+#define LZ77_TARGET(isa)
+#endif
+
+namespace {
+
+const char* const LEVEL_NAMES[] = { "scalar", "sse2", "avx2", "avx512" };
+
+// Scalar kernels, which the vector ones also finish their tails with
+
+size_t matchLengthScalar(const char* a, const char* b, size_t limit) {
+    size_t length = 0;
+    while (length < limit && a[length] == b[length]) {
+        ++length;
+    }
+    return length;
+}
+
+size_t findCandidateScalar(const char* data, size_t start, size_t end, size_t pos, size_t needed) {
+    const char first = data[pos];
+    const char last = data[pos + needed - 1];
+    for (size_t i = start; i < end; ++i) {
+        if (data[i + needed - 1] == last && data[i] == first) {
+            return i;
+        }
+    }
+    return end;
+}
+
+void copyMatchScalar(char* out, size_t offset, size_t length) {
+    const char* match = out - offset;
+    for (size_t i = 0; i < length; ++i) {
+        out[i] = match[i];
+    }
+}
+
+#ifdef LZ77_SIMD_X86
+
+size_t countTrailingZeros(uint64_t value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return index;
+#else
+    return static_cast<size_t>(__builtin_ctzll(value));
+#endif
+}
+
+// Every x86-64 CPU has SSE2, so these need no target attribute
+
+size_t matchLengthSSE2(const char* a, const char* b, size_t limit) {
+    size_t length = 0;
+    for (; length + 16 <= limit; length += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + length));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + length));
+        uint32_t differ = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y))) ^ 0xFFFF;
+        if (differ != 0) {
+            return length + countTrailingZeros(differ);
+        }
+    }
+    return length + matchLengthScalar(a + length, b + length, limit - length);
+}
+
+size_t findCandidateSSE2(const char* data, size_t start, size_t end, size_t pos, size_t needed) {
+    const __m128i first = _mm_set1_epi8(data[pos]);
+    const __m128i last = _mm_set1_epi8(data[pos + needed - 1]);
+    size_t i = start;
+    for (; i + 16 <= end; i += 16) {
+        __m128i heads = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i tails = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + needed - 1));
+        __m128i both = _mm_and_si128(_mm_cmpeq_epi8(heads, first), _mm_cmpeq_epi8(tails, last));
+        uint32_t found = static_cast<uint32_t>(_mm_movemask_epi8(both));
+        if (found != 0) {
+            return i + countTrailingZeros(found);
+        }
+    }
+    return findCandidateScalar(data, i, end, pos, needed);
+}
+
+// Whole vectors are copied only when the match starts at least a vector back, so
+// each one reads bytes that are already in place
+void copyMatchSSE2(char* out, size_t offset, size_t length) {
+    size_t i = 0;
+    if (offset >= 16) {
+        for (; i + 16 <= length; i += 16) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(out + i - offset));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), bytes);
+        }
+    }
+    copyMatchScalar(out + i, offset, length - i);
+}
+
+LZ77_TARGET("avx2")
+size_t matchLengthAVX2(const char* a, const char* b, size_t limit) {
+    size_t length = 0;
+    for (; length + 32 <= limit; length += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + length));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + length));
+        uint32_t differ = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+        if (differ != 0) {
+            return length + countTrailingZeros(differ);
+        }
+    }
+    return length + matchLengthSSE2(a + length, b + length, limit - length);
+}
+
+LZ77_TARGET("avx2")
+size_t findCandidateAVX2(const char* data, size_t start, size_t end, size_t pos, size_t needed) {
+    const __m256i first = _mm256_set1_epi8(data[pos]);
+    const __m256i last = _mm256_set1_epi8(data[pos + needed - 1]);
+    size_t i = start;
+    for (; i + 32 <= end; i += 32) {
+        __m256i heads = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i tails = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + needed - 1));
+        __m256i both = _mm256_and_si256(_mm256_cmpeq_epi8(heads, first), _mm256_cmpeq_epi8(tails, last));
+        uint32_t found = static_cast<uint32_t>(_mm256_movemask_epi8(both));
+        if (found != 0) {
+            return i + countTrailingZeros(found);
+        }
+    }
+    return findCandidateSSE2(data, i, end, pos, needed);
+}
+
+LZ77_TARGET("avx2")
+void copyMatchAVX2(char* out, size_t offset, size_t length) {
+    size_t i = 0;
+    if (offset >= 32) {
+        for (; i + 32 <= length; i += 32) {
+            __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(out + i - offset));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), bytes);
+        }
+    }
+    copyMatchSSE2(out + i, offset, length - i);
+}
+
+// AVX-512 kernels finish with masked loads, which don't fault on the bytes they skip
+
+LZ77_TARGET("avx512f,avx512bw")
+__mmask64 leadingLanes(size_t count) {
+    return count >= 64 ? ~static_cast<__mmask64>(0) : (static_cast<__mmask64>(1) << count) - 1;
+}
+
+LZ77_TARGET("avx512f,avx512bw")
+size_t matchLengthAVX512(const char* a, const char* b, size_t limit) {
+    for (size_t length = 0; length < limit; length += 64) {
+        __mmask64 lanes = leadingLanes(limit - length);
+        __m512i x = _mm512_maskz_loadu_epi8(lanes, a + length);
+        __m512i y = _mm512_maskz_loadu_epi8(lanes, b + length);
+        uint64_t differ = _mm512_mask_cmpneq_epi8_mask(lanes, x, y);
+        if (differ != 0) {
+            return length + countTrailingZeros(differ);
+        }
+    }
+    return limit;
+}
+
+LZ77_TARGET("avx512f,avx512bw")
+size_t findCandidateAVX512(const char* data, size_t start, size_t end, size_t pos, size_t needed) {
+    const __m512i first = _mm512_set1_epi8(data[pos]);
+    const __m512i last = _mm512_set1_epi8(data[pos + needed - 1]);
+    for (size_t i = start; i < end; i += 64) {
+        __mmask64 lanes = leadingLanes(end - i);
+        __m512i heads = _mm512_maskz_loadu_epi8(lanes, data + i);
+        __m512i tails = _mm512_maskz_loadu_epi8(lanes, data + i + needed - 1);
+        uint64_t found = _mm512_mask_cmpeq_epi8_mask(_mm512_mask_cmpeq_epi8_mask(lanes, heads, first), tails, last);
+        if (found != 0) {
+            return i + countTrailingZeros(found);
+        }
+    }
+    return end;
+}
+
+LZ77_TARGET("avx512f,avx512bw")
+void copyMatchAVX512(char* out, size_t offset, size_t length) {
+    size_t i = 0;
+    if (offset >= 64) {
+        for (; i < length; i += 64) {
+            __mmask64 lanes = leadingLanes(length - i);
+            __m512i bytes = _mm512_maskz_loadu_epi8(lanes, out + i - offset);
+            _mm512_mask_storeu_epi8(out + i, lanes, bytes);
+        }
+        return;
+    }
+    copyMatchAVX2(out, offset, length);
+}
+
+#endif // LZ77_SIMD_X86
+
+// Indexed by SimdLevel; other architectures have the scalar kernels only
+const SimdKernels KERNELS[] = {
+    { SimdLevel::Scalar, &matchLengthScalar, &findCandidateScalar, &copyMatchScalar },
+#ifdef LZ77_SIMD_X86
+    { SimdLevel::SSE2, &matchLengthSSE2, &findCandidateSSE2, &copyMatchSSE2 },
+    { SimdLevel::AVX2, &matchLengthAVX2, &findCandidateAVX2, &copyMatchAVX2 },
+    { SimdLevel::AVX512, &matchLengthAVX512, &findCandidateAVX512, &copyMatchAVX512 },
+#endif
+};
+
+SimdLevel detectCpu() {
+#if !defined(LZ77_SIMD_X86)
+    return SimdLevel::Scalar;
+#elif defined(_WIN32) && defined(__GNUC__) && !defined(__clang__)
+    // MinGW-w64 GCC keeps the stack only 16-byte aligned on Windows yet spills AVX
+    // registers with aligned moves (GCC bug 54412), so the wider kernels can crash there
+    return SimdLevel::SSE2;
+#elif defined(__GNUC__)
+    // These also check that the operating system saves the wider registers
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+        return SimdLevel::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return SimdLevel::AVX2;
+    }
+    return SimdLevel::SSE2;
+#else
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuidex(info, 1, 0);
+    bool osSavesAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0;
+    if (!osSavesAvx || maxLeaf < 7) {
+        return SimdLevel::SSE2;
+    }
+
+    // XCR0 has to show the YMM state, and for AVX-512 the opmask and ZMM state, enabled
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x06) == 0x06;
+    bool avx512 = (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0 && (xcr0 & 0xE6) == 0xE6;
+    return avx512 ? SimdLevel::AVX512 : avx2 ? SimdLevel::AVX2 : SimdLevel::SSE2;
+#endif
+}
+
+SimdLevel startupLevel() {
+    SimdLevel level = detectedSimdLevel();
+    SimdLevel forced;
+    const char* name = std::getenv("LZ77_SIMD");
+    if (name && parseSimdLevel(name, forced)) {
+        level = std::min(level, forced);
+    }
+    return level;
+}
+
+std::atomic<const SimdKernels*>& boundKernels() {
+    static std::atomic<const SimdKernels*> kernels(&KERNELS[static_cast<size_t>(startupLevel())]);
+    return kernels;
+}
+
+} // namespace
+
+SimdLevel detectedSimdLevel() {
+    static const SimdLevel level = detectCpu();
+    return level;
+}
+
+const SimdKernels& simdKernels() {
+    return *boundKernels().load(std::memory_order_acquire);
+}
+
+SimdLevel setSimdLevel(SimdLevel level) {
+    level = std::min(level, detectedSimdLevel());
+    boundKernels().store(&KERNELS[static_cast<size_t>(level)], std::memory_order_release);
+    return level;
+}
+
+const char* simdLevelName(SimdLevel level) {
+    return LEVEL_NAMES[static_cast<size_t>(level)];
+}
+
+bool parseSimdLevel(const std::string& name, SimdLevel& level) {
+    for (size_t i = 0; i < sizeof(LEVEL_NAMES) / sizeof(LEVEL_NAMES[0]); ++i) {
+        if (name == LEVEL_NAMES[i]) {
+            level = static_cast<SimdLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
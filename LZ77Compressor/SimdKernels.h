@@ -0,0 +1,49 @@
+#ifndef SIMDKERNELS_H
+#define SIMDKERNELS_H
+
+#include <cstddef>
+#include <string>
+
+// Instruction sets the hot kernels are built for, lowest first. Every level gives the
+// same results; one binary runs on any x86-64 host and uses the best level it has.
+enum class SimdLevel {
+    Scalar,
+    SSE2,
+    AVX2,
+    AVX512     // AVX-512BW
+};
+
+// Kernels for one level, bound once and shared by every thread
+struct SimdKernels {
+    SimdLevel level;
+
+    // Bytes at b that repeat those at a, up to limit
+    size_t (*matchLength)(const char* a, const char* b, size_t limit);
+
+    // First window position i in [start, end) where data[i] and data[i + needed - 1] equal the
+    // bytes at pos and pos + needed - 1, as they must for a match of needed bytes; end if none.
+    // Reads up to data[end + needed - 2].
+    size_t (*findCandidate)(const char* data, size_t start, size_t end, size_t pos, size_t needed);
+
+    // Copy length bytes to out from offset bytes before it, front to back, so a match may
+    // overlap the bytes it produces
+    void (*copyMatch)(char* out, size_t offset, size_t length);
+};
+
+// Highest level this CPU and operating system support, detected on first use. Builds with
+// MinGW-w64 GCC stop at SSE2, as that compiler can't align the stack for AVX code.
+SimdLevel detectedSimdLevel();
+
+// The kernels in use: the detected level's, or a lower one named by the LZ77_SIMD
+// environment variable or setSimdLevel(). Callers look them up once per block.
+const SimdKernels& simdKernels();
+
+// Bind a level's kernels, for testing and benchmarking. A level above the detected
+// one is capped to it; returns the level bound.
+SimdLevel setSimdLevel(SimdLevel level);
+
+// scalar, sse2, avx2 or avx512
+const char* simdLevelName(SimdLevel level);
+bool parseSimdLevel(const std::string& name, SimdLevel& level);
+
+#endif // SIMDKERNELS_H
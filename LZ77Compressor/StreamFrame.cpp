@@ -0,0 +1,422 @@
+#include "StreamFrame.h"
+#include "BoundedQueue.h"
+#include "BufferPool.h"
+#include "CodecRegistry.h"
+#include "LZ77Codec.h"
+#include "MemoryBudget.h"
+#include "SimdKernels.h"
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Blocks queued per worker thread
+const size_t STREAM_QUEUE_DEPTH = 4;
+
+namespace {
+
+// A block on its way from the reader through a worker to the writer
+struct StreamBlock {
+    BlockCodec codec = BlockCodec::Stored;
+    size_t rawSize = 0;
+    std::vector<char> data;       // Raw bytes: read when compressing, decoded when decompressing
+    std::vector<char> payload;    // Codec payload: encoded when compressing, read when decompressing
+    std::promise<void> done;
+};
+
+// The reader is the calling thread; worker threads encode or decode blocks, and a
+// writer thread puts them on the output in order. Blocks read ahead of the writer are
+// bounded by the write queue's capacity.
+struct StreamContext {
+    StreamContext(size_t threads, size_t inFlightBlocks, size_t retainedBytes)
+        : threads(threads),
+          buffers(BufferPool::DEFAULT_RETAINED_BUFFERS, retainedBytes),
+          workQueue(threads * STREAM_QUEUE_DEPTH),
+          writeQueue(inFlightBlocks) {}
+
+    size_t threads;
+    const CancellationToken* cancel = nullptr;
+    const Codec* codec = nullptr;
+    FilterChain filters;
+    LZ77Settings settings;
+    BufferPool buffers;
+
+    BoundedQueue<std::shared_ptr<StreamBlock>> workQueue;
+    BoundedQueue<std::shared_ptr<StreamBlock>> writeQueue;
+    std::exception_ptr firstError;
+    std::mutex errorMutex;
+
+    JobStats stats;
+    std::mutex statsMutex;
+
+    // Writer state: the output, its time spent writing, and the size and hash of the raw
+    // stream it has seen
+    std::ostream* output = nullptr;
+    uint64_t writeNanoseconds = 0;
+    uint64_t rawBytes = 0;
+    uint64_t rawHash = FNV_OFFSET_BASIS;
+};
+
+using WorkStage = void (*)(StreamBlock& block, StreamContext& context, CodecWorkspace& workspace);
+using WriteStage = void (*)(StreamBlock& block, StreamContext& context);
+
+// Function prototypes
+void runPipeline(StreamContext& context, const std::function<void()>& readStage, WorkStage workStage,
+                 WriteStage writeStage);
+void recordError(StreamContext& context);
+bool submitBlock(StreamContext& context, std::shared_ptr<StreamBlock> block);
+size_t readFully(std::istream& input, char* data, size_t size);
+uint64_t frameHeaderSize(const FilterChain& filters);
+void encodeStreamBlock(StreamBlock& block, StreamContext& context, CodecWorkspace& workspace);
+void writeEncodedBlock(StreamBlock& block, StreamContext& context);
+void decodeStreamBlock(StreamBlock& block, StreamContext& context, CodecWorkspace& workspace);
+void writeDecodedBlock(StreamBlock& block, StreamContext& context);
+
+void runPipeline(StreamContext& context, const std::function<void()>& readStage, WorkStage workStage,
+                 WriteStage writeStage) {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < context.threads; ++i) {
+        threads.emplace_back([&context, workStage]() {
+            CodecWorkspace workspace;
+            workspace.cancel = context.cancel;
+
+            std::shared_ptr<StreamBlock> block;
+            while (context.workQueue.pop(block)) {
+                try {
+                    workStage(*block, context, workspace);
+                    block->done.set_value();
+                } catch (...) {
+                    block->done.set_exception(std::current_exception());
+                }
+                block.reset();
+            }
+
+            std::lock_guard<std::mutex> lock(context.statsMutex);
+            context.stats.tokens.merge(workspace.tokenStats);
+            context.stats.stages.merge(workspace.times);
+        });
+    }
+    threads.emplace_back([&context, writeStage]() {
+        std::shared_ptr<StreamBlock> block;
+        while (context.writeQueue.pop(block)) {
+            try {
+                block->done.get_future().get();
+                throwIfCancelled(context.cancel);
+                writeStage(*block, context);
+                context.buffers.release(std::move(block->data));
+                context.buffers.release(std::move(block->payload));
+            } catch (...) {
+                recordError(context);
+            }
+            block.reset();
+        }
+    });
+
+    try {
+        readStage();
+    } catch (...) {
+        recordError(context);
+    }
+
+    context.workQueue.close();
+    context.writeQueue.close();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    context.stats.buffers = context.buffers.stats();
+
+    if (context.firstError) {
+        std::rethrow_exception(context.firstError);
+    }
+}
+
+// Keep the first failure and stop every stage
+void recordError(StreamContext& context) {
+    {
+        std::lock_guard<std::mutex> lock(context.errorMutex);
+        if (!context.firstError) {
+            context.firstError = std::current_exception();
+        }
+    }
+    context.workQueue.close();
+    context.writeQueue.close();
+}
+
+// Queue a block for the writer, then for a worker. Returns false once the pipeline has stopped.
+bool submitBlock(StreamContext& context, std::shared_ptr<StreamBlock> block) {
+    return context.writeQueue.push(block) && context.workQueue.push(std::move(block));
+}
+
+// Read until size bytes or the end of the input, as a pipe delivers data in pieces
+size_t readFully(std::istream& input, char* data, size_t size) {
+    input.read(data, static_cast<std::streamsize>(size));
+    if (input.bad()) {
+        throw std::runtime_error("Failed to read input.");
+    }
+    return static_cast<size_t>(input.gcount());
+}
+
+uint64_t frameHeaderSize(const FilterChain& filters) {
+    uint64_t size = 8 + varUIntSize(filters.size()) + filters.size();
+    for (const auto& filter : filters) {
+        size += varUIntSize(filter.parameter);
+    }
+    return size;
+}
+
+// Compress a block as compressArchive() does: the codec sees it through the filters,
+// and blocks that don't shrink are stored unfiltered
+void encodeStreamBlock(StreamBlock& block, StreamContext& context, CodecWorkspace& workspace) {
+    block.codec = BlockCodec::Stored;
+    if (isLikelyIncompressible(block.data.data(), block.rawSize)) {
+        return;
+    }
+
+    const char* input = block.data.data();
+    if (!context.filters.empty()) {
+        StageTimer timer(workspace.times.filteringNanoseconds);
+        applyFilters(context.filters, block.data.data(), block.rawSize, workspace.filtered, workspace.filterScratch);
+        input = workspace.filtered.data();
+    }
+
+    block.payload = context.buffers.acquire(context.codec->bound(block.rawSize));
+    if (context.codec->compress(input, block.rawSize, context.settings, workspace, block.payload)) {
+        block.codec = context.codec->id();
+    } else {
+        block.payload.clear();
+    }
+}
+
+void writeEncodedBlock(StreamBlock& block, StreamContext& context) {
+    StageTimer timer(context.writeNanoseconds);
+    std::ostream& output = *context.output;
+    const std::vector<char>& payload = block.codec == BlockCodec::Stored ? block.data : block.payload;
+
+    output.put(static_cast<char>(block.codec));
+    writeVarUInt(output, block.rawSize);
+    writeVarUInt(output, payload.size());
+    output.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+    if (!output) {
+        throw std::runtime_error("Failed to write output.");
+    }
+    context.stats.bytesOut += 1 + varUIntSize(block.rawSize) + varUIntSize(payload.size()) + payload.size();
+}
+
+void decodeStreamBlock(StreamBlock& block, StreamContext& context, CodecWorkspace& workspace) {
+    if (block.codec == BlockCodec::Stored) {
+        block.data.swap(block.payload);
+        return;
+    }
+
+    {
+        StageTimer timer(workspace.times.decodingNanoseconds);
+        block.data = context.buffers.acquire(block.rawSize);
+        block.data.resize(block.rawSize);
+        findCodec(block.codec)->decompress(block.payload.data(), block.payload.size(), block.data.data(),
+                                           block.rawSize, &workspace.tokenStats);
+    }
+    if (!context.filters.empty()) {
+        StageTimer timer(workspace.times.filteringNanoseconds);
+        reverseFilters(context.filters, block.data, workspace.filterScratch);
+    }
+}
+
+void writeDecodedBlock(StreamBlock& block, StreamContext& context) {
+    StageTimer timer(context.writeNanoseconds);
+    context.output->write(block.data.data(), static_cast<std::streamsize>(block.rawSize));
+    if (!*context.output) {
+        throw std::runtime_error("Failed to write output.");
+    }
+    context.rawBytes += block.rawSize;
+    context.rawHash = hashData(block.data.data(), block.rawSize, context.rawHash);
+}
+
+} // namespace
+
+JobStats compressStream(std::istream& input, std::ostream& output, const StreamOptions& options,
+                        const CancellationToken* cancel) {
+    JobClock clock;
+
+    if (options.level < MIN_COMPRESSION_LEVEL || options.level > MAX_COMPRESSION_LEVEL) {
+        throw std::runtime_error("Invalid compression level.");
+    }
+    const Codec* codec = findCodec(options.codec);
+    if (!codec) {
+        throw std::runtime_error("Unknown codec.");
+    }
+    if (!validFilterChain(options.filters)) {
+        throw std::runtime_error("Invalid filter chain.");
+    }
+
+    // Without a budget, as many blocks wait for the writer as in an archive job
+    size_t scratchBytes = codec->encodeWorkspaceBytes(MAX_BLOCK_SIZE) + (options.filters.empty() ? 0 : 2 * MAX_BLOCK_SIZE);
+    CompressionPlan plan = planCompression(options.maxMemory, options.threads, scratchBytes);
+    size_t inFlightBlocks = plan.threads * STREAM_QUEUE_DEPTH * 2;
+    if (options.maxMemory != 0) {
+        inFlightBlocks = std::max<size_t>(1, std::min(inFlightBlocks, plan.inFlightBytes / BLOCK_SIZE));
+    }
+
+    StreamContext context(plan.threads, inFlightBlocks, plan.retainedBytes);
+    context.cancel = cancel;
+    context.codec = codec;
+    context.filters = options.filters;
+    context.settings = settingsForLevel(options.level);
+    context.output = &output;
+    context.stats.operation = "compress-stream";
+    context.stats.ioBackend = "stream";
+    context.stats.simdLevel = simdLevelName(simdKernels().level);
+
+    output.write("MYSTRM", 6);
+    output.put('\0');
+    output.put(static_cast<char>(STREAM_VERSION));
+    writeFilterChain(output, options.filters);
+    context.stats.bytesOut = frameHeaderSize(options.filters);
+
+    uint64_t readNanoseconds = 0;
+    runPipeline(context, [&]() {
+        for (;;) {
+            throwIfCancelled(cancel);
+            auto block = std::make_shared<StreamBlock>();
+            block->data = context.buffers.acquire(BLOCK_SIZE);
+            block->data.resize(BLOCK_SIZE);
+            {
+                StageTimer timer(readNanoseconds);
+                block->rawSize = readFully(input, block->data.data(), BLOCK_SIZE);
+            }
+            if (block->rawSize == 0) {
+                context.buffers.release(std::move(block->data));
+                return;
+            }
+            block->data.resize(block->rawSize);
+            context.rawBytes += block->rawSize;
+            context.rawHash = hashData(block->data.data(), block->rawSize, context.rawHash);
+
+            bool last = block->rawSize < BLOCK_SIZE;
+            if (!submitBlock(context, std::move(block)) || last) {
+                return;
+            }
+        }
+    }, encodeStreamBlock, writeEncodedBlock);
+
+    output.put(static_cast<char>(STREAM_END));
+    writeVarUInt(output, context.rawBytes);
+    writeUInt64(output, context.rawHash);
+    output.flush();
+    if (!output) {
+        throw std::runtime_error("Failed to write output.");
+    }
+    context.stats.bytesOut += 1 + varUIntSize(context.rawBytes) + sizeof(uint64_t);
+
+    JobStats& stats = context.stats;
+    stats.bytesIn = context.rawBytes;
+    stats.stages.ioNanoseconds += readNanoseconds + context.writeNanoseconds;
+    clock.stop(stats);
+    return std::move(context.stats);
+}
+
+JobStats decompressStream(std::istream& input, std::ostream& output, const StreamOptions& options,
+                          const CancellationToken* cancel) {
+    JobClock clock;
+
+    char magic[6];
+    input.read(magic, sizeof(magic));
+    if (!input || std::string(magic, sizeof(magic)) != "MYSTRM" || input.get() != 0) {
+        throw std::runtime_error("Input is not a stream frame.");
+    }
+    int version = input.get();
+    if (version > STREAM_VERSION) {
+        throw std::runtime_error("Stream frame version " + std::to_string(version) +
+                                 " is newer than this build supports.");
+    }
+    FilterChain filters = readFilterChain(input);
+    if (!input || version < 1) {
+        throw std::runtime_error("Invalid stream frame header.");
+    }
+
+    // Any codec may turn up, so threads are planned for the one needing the most scratch.
+    // Stream blocks are at most half the MAX_BLOCK_SIZE blocks the plan assumes, so each
+    // thread's share holds two of them: one being decoded and one waiting for the writer.
+    size_t scratchBytes = filters.empty() ? 0 : MAX_BLOCK_SIZE;
+    size_t decodeBytes = 0;
+    for (const Codec* codec : registeredCodecs()) {
+        decodeBytes = std::max(decodeBytes, codec->decodeWorkspaceBytes(BLOCK_SIZE));
+    }
+    ExtractionPlan plan = planExtraction(options.maxMemory, options.threads, scratchBytes + decodeBytes);
+
+    StreamContext context(plan.threads, plan.threads * 2, plan.retainedBytes);
+    context.cancel = cancel;
+    context.filters = filters;
+    context.output = &output;
+    context.stats.operation = "decompress-stream";
+    context.stats.ioBackend = "stream";
+    context.stats.simdLevel = simdLevelName(simdKernels().level);
+    context.stats.bytesIn = frameHeaderSize(filters);
+
+    uint64_t readNanoseconds = 0;
+    uint64_t expectedBytes = 0;
+    uint64_t expectedHash = 0;
+    runPipeline(context, [&]() {
+        StageTimer timer(readNanoseconds);
+        for (;;) {
+            throwIfCancelled(cancel);
+            int codecByte = input.get();
+            if (codecByte == STREAM_END) {
+                expectedBytes = readVarUInt(input);
+                expectedHash = readUInt64(input);
+                if (!input) {
+                    throw std::runtime_error("Unexpected end of stream.");
+                }
+                context.stats.bytesIn += 1 + varUIntSize(expectedBytes) + sizeof(uint64_t);
+                if (input.peek() != std::char_traits<char>::eof()) {
+                    throw std::runtime_error("Unexpected data after the end of the stream.");
+                }
+                return;
+            }
+
+            auto block = std::make_shared<StreamBlock>();
+            block->codec = static_cast<BlockCodec>(codecByte);
+            uint64_t rawSize = readVarUInt(input);
+            uint64_t payloadSize = readVarUInt(input);
+            if (codecByte == std::char_traits<char>::eof() || !input) {
+                throw std::runtime_error("Unexpected end of stream.");
+            }
+            const Codec* codec = findCodec(block->codec);
+            if (!codec || rawSize == 0 || rawSize > plan.blockBytes || payloadSize > codec->bound(rawSize) ||
+                !codec->validSizes(payloadSize, rawSize)) {
+                throw std::runtime_error("Invalid block header in stream.");
+            }
+
+            block->rawSize = static_cast<size_t>(rawSize);
+            block->payload = context.buffers.acquire(payloadSize);
+            block->payload.resize(payloadSize);
+            if (readFully(input, block->payload.data(), payloadSize) != payloadSize) {
+                throw std::runtime_error("Unexpected end of stream.");
+            }
+            context.stats.bytesIn += 1 + varUIntSize(rawSize) + varUIntSize(payloadSize) + payloadSize;
+
+            if (!submitBlock(context, std::move(block))) {
+                return;
+            }
+        }
+    }, decodeStreamBlock, writeDecodedBlock);
+
+    output.flush();
+    if (!output) {
+        throw std::runtime_error("Failed to write output.");
+    }
+    if (context.rawBytes != expectedBytes || context.rawHash != expectedHash) {
+        throw std::runtime_error("Stream content does not match its checksum.");
+    }
+
+    JobStats& stats = context.stats;
+    stats.bytesOut = context.rawBytes;
+    stats.stages.ioNanoseconds += readNanoseconds + context.writeNanoseconds;
+    clock.stop(stats);
+    return std::move(context.stats);
+}
@@ -0,0 +1,45 @@
+#ifndef STREAMFRAME_H
+#define STREAMFRAME_H
+
+#include "ArchiveCompressor.h"
+#include "ArchiveFormat.h"
+#include "Filters.h"
+#include "JobProgress.h"
+#include "JobStats.h"
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+
+// A stream frame holds one unnamed stream, such as tar output in a pipeline, and is
+// written and read front to back, so neither end has to be a file that can seek. It
+// starts with the MYSTRM magic, a zero byte, the version and the filter chain (see
+// Filters.h). Blocks of up to BLOCK_SIZE bytes follow, laid out as in archives: codec,
+// varint raw size, varint payload size and payload. A STREAM_END byte in place of a
+// codec ends the frame, followed by the varint stream size and its FNV-1a hash (u64).
+const uint8_t STREAM_VERSION = 1;
+const uint8_t STREAM_END = 0xFF;
+
+struct StreamOptions {
+    // For compression: codec, filters and level as in CompressOptions
+    BlockCodec codec = BlockCodec::LZ77Repeat;
+    FilterChain filters;
+    int level = DEFAULT_COMPRESSION_LEVEL;
+
+    size_t threads = 0;     // 0 uses one per hardware thread
+    size_t maxMemory = 0;   // Budget for blocks in flight and thread scratch; 0 for the defaults
+};
+
+// Compress input into a frame on output. Blocks are compressed in parallel and written
+// in order, with at most a bounded number read ahead of the output. Input and output
+// are used from different threads, so input mustn't be tied to output. Throws
+// std::runtime_error on failure, or JobCancelled once cancel is triggered.
+JobStats compressStream(std::istream& input, std::ostream& output, const StreamOptions& options = StreamOptions(),
+                        const CancellationToken* cancel = nullptr);
+
+// Decompress a frame from input onto output, decoding blocks in parallel. Throws
+// std::runtime_error if the frame is corrupt, truncated or followed by other data.
+JobStats decompressStream(std::istream& input, std::ostream& output, const StreamOptions& options = StreamOptions(),
+                          const CancellationToken* cancel = nullptr);
+
+#endif // STREAMFRAME_H
@@ -0,0 +1,31 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <iostream>
+
+// Trace levels, from least to most verbose
+#define LZ77_TRACE_NONE 0
+#define LZ77_TRACE_INFO 1
+#define LZ77_TRACE_BLOCK 2
+#define LZ77_TRACE_TOKEN 3
+
+// Release builds trace nothing and debug builds trace everything, unless the
+// build sets LZ77_TRACE_LEVEL explicitly
+#ifndef LZ77_TRACE_LEVEL
+#ifdef NDEBUG
+#define LZ77_TRACE_LEVEL LZ77_TRACE_NONE
+#else
+#define LZ77_TRACE_LEVEL LZ77_TRACE_TOKEN
+#endif
+#endif
+
+// Write a line to stderr if the level is enabled. Disabled levels are discarded
+// by if constexpr, so their arguments are never evaluated and no code is emitted.
+#define LZ77_TRACE(level, message)                      \
+    do {                                                \
+        if constexpr ((level) <= LZ77_TRACE_LEVEL) {    \
+            std::cerr << message << '\n';               \
+        }                                               \
+    } while (0)
+
+#endif // TRACE_H
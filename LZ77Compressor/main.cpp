@@ -109,7 +109,7 @@ void connectFileSelectors(QPushButton* browseInputButton, QPushButton* browseOut
 }
 
 // Function to handle operation logic
-void connectOperationButtons(QPushButton* compressButton, QPushButton* decompressButton, QProgressBar* progressBar, QLabel* statusLabel, QRadioButton* compressRadioButton, QRadioButton* fileRadioButton, QLineEdit* inputLineEdit, QLineEdit* outputLineEdit, QWidget* window) {
+void connectOperationButtons(QPushButton* compressButton, QPushButton* decompressButton, QPushButton* cancelButton, QProgressBar* progressBar, QLabel* statusLabel, QRadioButton* compressRadioButton, QRadioButton* fileRadioButton, QLineEdit* inputLineEdit, QLineEdit* outputLineEdit, QWidget* window) {
     auto operationHandler = [=]() {
         bool isCompression = compressRadioButton->isChecked();
         QString inputPath = inputLineEdit->text();
@@ -153,6 +153,7 @@ void connectOperationButtons(QPushButton* compressButton, QPushButton* decompres
 
         compressButton->setEnabled(false);
         decompressButton->setEnabled(false);
+        cancelButton->setEnabled(true);
         progressBar->setValue(0);
         statusLabel->setStyleSheet("font-size: 16px; color: blue;");
         statusLabel->setText(isCompression ? "Compressing..." : "Decompressing...");
@@ -165,10 +166,13 @@ void connectOperationButtons(QPushButton* compressButton, QPushButton* decompres
 
             QObject::connect(thread, &QThread::started, compressor, &CompressorWorker::process);
             QObject::connect(compressor, &CompressorWorker::progress, progressBar, &QProgressBar::setValue);
+            // Direct, since the worker's thread is busy running the job; cancel() only sets a flag
+            QObject::connect(cancelButton, &QPushButton::clicked, compressor, &CompressorWorker::cancel, Qt::DirectConnection);
 
             QObject::connect(compressor, &CompressorWorker::finished, window, [=]() {
                 compressButton->setEnabled(true);
                 decompressButton->setEnabled(true);
+                cancelButton->setEnabled(false);
                 progressBar->setValue(100);
                 statusLabel->setStyleSheet("font-size: 16px; color: green;");
                 statusLabel->setText("Compression completed successfully.");
@@ -177,6 +181,7 @@ void connectOperationButtons(QPushButton* compressButton, QPushButton* decompres
             QObject::connect(compressor, &CompressorWorker::error, window, [=](const QString &message) {
                 compressButton->setEnabled(true);
                 decompressButton->setEnabled(true);
+                cancelButton->setEnabled(false);
                 statusLabel->setStyleSheet("font-size: 16px; color: red;");
                 statusLabel->setText("Error: " + message);
                 thread->quit();
@@ -192,10 +197,12 @@ void connectOperationButtons(QPushButton* compressButton, QPushButton* decompres
 
             QObject::connect(thread, &QThread::started, decompressor, &DecompressWorker::process);
             QObject::connect(decompressor, &DecompressWorker::progress, progressBar, &QProgressBar::setValue);
+            QObject::connect(cancelButton, &QPushButton::clicked, decompressor, &DecompressWorker::cancel, Qt::DirectConnection);
 
             QObject::connect(decompressor, &DecompressWorker::finished, window, [=]() {
                 compressButton->setEnabled(true);
                 decompressButton->setEnabled(true);
+                cancelButton->setEnabled(false);
                 progressBar->setValue(100);
                 statusLabel->setStyleSheet("font-size: 16px; color: green;");
                 statusLabel->setText("Decompression completed successfully.");
@@ -204,6 +211,7 @@ void connectOperationButtons(QPushButton* compressButton, QPushButton* decompres
             QObject::connect(decompressor, &DecompressWorker::error, window, [=](const QString &message) {
                 compressButton->setEnabled(true);
                 decompressButton->setEnabled(true);
+                cancelButton->setEnabled(false);
                 statusLabel->setStyleSheet("font-size: 16px; color: red;");
                 statusLabel->setText("Error: " + message);
                 thread->quit();
@@ -273,14 +281,17 @@ int main(int argc, char *argv[]) {
 
     QPushButton *compressButton = new QPushButton("Compress");
     QPushButton *decompressButton = new QPushButton("Decompress");
+    QPushButton *cancelButton = new QPushButton("Cancel");
+    cancelButton->setEnabled(false);
     QHBoxLayout *buttonsLayout = new QHBoxLayout();
     buttonsLayout->addWidget(compressButton);
     buttonsLayout->addWidget(decompressButton);
+    buttonsLayout->addWidget(cancelButton);
     layout->addLayout(buttonsLayout);
     layout->setAlignment(buttonsLayout, Qt::AlignCenter);
 
     connectFileSelectors(browseInputButton, browseOutputButton, inputLineEdit, outputLineEdit, compressRadioButton, fileRadioButton, &window);
-    connectOperationButtons(compressButton, decompressButton, progressBar, statusLabel, compressRadioButton, fileRadioButton, inputLineEdit, outputLineEdit, &window);
+    connectOperationButtons(compressButton, decompressButton, cancelButton, progressBar, statusLabel, compressRadioButton, fileRadioButton, inputLineEdit, outputLineEdit, &window);
 
     QObject::connect(compressRadioButton, &QRadioButton::toggled, [&](bool checked){
         modeWidget->setVisible(checked);
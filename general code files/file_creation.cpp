@@ -1,23 +1,234 @@
+// Seeded generator for reproducible benchmark corpora.
+//
+// Usage: file_creation [options]
+//   --output DIR           Corpus root directory (default: corpus)
+//   --seed N               Random seed; the same seed and options give the same corpus (default: 1)
+//   --files N              Number of files (default: 100)
+//   --min-size BYTES       Smallest file size (default: 1024)
+//   --max-size BYTES       Largest file size; sizes are log-uniform in between (default: 1048576)
+//   --depth N              Directory levels below the root (default: 2)
+//   --fanout N             Subdirectories per directory (default: 3)
+//   --entropy BITS         Bits per literal byte, 0 to 8 (default: 4.5)
+//   --repeat-fraction P    Share of the output copied from earlier data (default: 0.5)
+//   --match-length N       Mean length of a copy (default: 24)
+//   --max-distance N       Copies reach back up to this far, log-uniformly (default: 32768)
+//   --run-fraction P       Share of the output made of single-byte runs (default: 0.05)
+//   --run-length N         Mean run length (default: 32)
+
 #include <iostream>
 #include <fstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <algorithm>
 
-int main() {
-    int num_lines;
-    std::cout << "Enter the number of lines you want in the file: ";
-    std::cin >> num_lines;
+namespace fs = std::filesystem;
 
-    std::ofstream outfile("basic_text_file.txt");
-    if (!outfile.is_open()) {
-        std::cerr << "Failed to create the file.\n";
-        return 1;
+struct CorpusOptions {
+    fs::path output = "corpus";
+    uint64_t seed = 1;
+    size_t files = 100;
+    size_t min_size = 1024;
+    size_t max_size = 1024 * 1024;
+    int depth = 2;
+    int fanout = 3;
+    double entropy = 4.5;
+    double repeat_fraction = 0.5;
+    double match_length = 24;
+    size_t max_distance = 32768;
+    double run_fraction = 0.05;
+    double run_length = 32;
+};
+
+// Literals are drawn uniformly from the first 2^entropy symbols, so small alphabets look like text
+const std::string SYMBOLS = " etaoinshrdlcumwfgypbvkjxqzETAOINSHRDLCUMWFGYPBVKJXQZ0123456789.,;:'\"!?-\n";
+
+// mt19937_64's output sequence is fixed by the standard, but the std distributions
+// are not, so values are derived from the raw output to stay identical across platforms
+class CorpusRandom {
+public:
+    explicit CorpusRandom(uint64_t seed) : engine(seed) {}
+
+    // Uniform in [0, n)
+    uint64_t below(uint64_t n) {
+        return n == 0 ? 0 : engine() % n;
+    }
+
+    // Uniform in [0, 1)
+    double unit() {
+        return static_cast<double>(engine() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // Log-uniform in [low, high]
+    uint64_t log_uniform(uint64_t low, uint64_t high) {
+        if (low >= high) {
+            return low;
+        }
+        double value = std::exp(std::log(static_cast<double>(low)) +
+                                unit() * (std::log(static_cast<double>(high) + 1) - std::log(static_cast<double>(low))));
+        return std::min<uint64_t>(high, static_cast<uint64_t>(value));
     }
 
-    // Write the specified number of lines to the file
-    for (int i = 1; i <= num_lines; ++i) {
-        outfile << "this is the most basic text file ever created and I want to compress it!" << i << "\n";
+    // Geometric with the given mean, at least 1
+    uint64_t geometric(double mean) {
+        if (mean <= 1) {
+            return 1;
+        }
+        double p = 1.0 / mean;
+        return 1 + static_cast<uint64_t>(std::log(1.0 - unit()) / std::log(1.0 - p));
     }
-    outfile.close();
 
-    std::cout << "File 'basic_text_file.txt' has been created with " << num_lines << " lines.\n";
+private:
+    std::mt19937_64 engine;
+};
+
+std::vector<char> generate_content(size_t size, const CorpusOptions& options, CorpusRandom& random) {
+    std::vector<char> data;
+    data.reserve(size);
+
+    // An alphabet of 2^entropy symbols gives about that many bits per literal
+    size_t alphabet = static_cast<size_t>(std::llround(std::pow(2.0, std::clamp(options.entropy, 0.0, 8.0))));
+    alphabet = std::clamp<size_t>(alphabet, 1, 256);
+    auto literal = [&]() -> char {
+        size_t symbol = random.below(alphabet);
+        return symbol < SYMBOLS.size() ? SYMBOLS[symbol] : static_cast<char>(symbol);
+    };
+
+    while (data.size() < size) {
+        double choice = random.unit();
+        size_t remaining = size - data.size();
+
+        if (choice < options.run_fraction) {
+            size_t length = std::min<size_t>(remaining, random.geometric(options.run_length));
+            data.insert(data.end(), length, literal());
+        } else if (choice < options.run_fraction + options.repeat_fraction && !data.empty()) {
+            size_t distance = random.log_uniform(1, std::min(options.max_distance, data.size()));
+            size_t length = std::min<size_t>(remaining, random.geometric(options.match_length));
+            size_t start = data.size() - distance;
+            for (size_t i = 0; i < length; ++i) {
+                data.push_back(data[start + i]);
+            }
+        } else {
+            data.push_back(literal());
+        }
+    }
+
+    return data;
+}
+
+// Builds the directory tree breadth first and returns every directory, root included
+std::vector<fs::path> create_directories(const CorpusOptions& options) {
+    std::vector<fs::path> directories = { options.output };
+    fs::create_directories(options.output);
+
+    size_t level_start = 0;
+    for (int level = 0; level < options.depth; ++level) {
+        size_t level_end = directories.size();
+        for (size_t parent = level_start; parent < level_end; ++parent) {
+            for (int child = 0; child < options.fanout; ++child) {
+                fs::path directory = directories[parent] / ("dir" + std::to_string(child));
+                fs::create_directories(directory);
+                directories.push_back(directory);
+            }
+        }
+        level_start = level_end;
+    }
+
+    return directories;
+}
+
+bool parse_options(int argc, char** argv, CorpusOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << option << "\n";
+            return false;
+        }
+        std::string value = argv[++i];
+
+        if (option == "--output") {
+            options.output = value;
+        } else if (option == "--seed") {
+            options.seed = std::stoull(value);
+        } else if (option == "--files") {
+            options.files = std::stoull(value);
+        } else if (option == "--min-size") {
+            options.min_size = std::stoull(value);
+        } else if (option == "--max-size") {
+            options.max_size = std::stoull(value);
+        } else if (option == "--depth") {
+            options.depth = std::stoi(value);
+        } else if (option == "--fanout") {
+            options.fanout = std::stoi(value);
+        } else if (option == "--entropy") {
+            options.entropy = std::stod(value);
+        } else if (option == "--repeat-fraction") {
+            options.repeat_fraction = std::stod(value);
+        } else if (option == "--match-length") {
+            options.match_length = std::stod(value);
+        } else if (option == "--max-distance") {
+            options.max_distance = std::stoull(value);
+        } else if (option == "--run-fraction") {
+            options.run_fraction = std::stod(value);
+        } else if (option == "--run-length") {
+            options.run_length = std::stod(value);
+        } else {
+            std::cerr << "Unknown option: " << option << "\n";
+            return false;
+        }
+    }
+
+    if (options.min_size > options.max_size || options.depth < 0 || options.fanout < 0 ||
+        options.repeat_fraction < 0 || options.run_fraction < 0 || options.repeat_fraction + options.run_fraction > 1) {
+        std::cerr << "Invalid corpus options.\n";
+        return false;
+    }
+    if (options.max_distance == 0) {
+        options.max_distance = 1;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    CorpusOptions options;
+    try {
+        if (!parse_options(argc, argv, options)) {
+            return 1;
+        }
+
+        CorpusRandom random(options.seed);
+        std::vector<fs::path> directories = create_directories(options);
+
+        uint64_t total_bytes = 0;
+        for (size_t i = 0; i < options.files; ++i) {
+            fs::path directory = directories[random.below(directories.size())];
+            size_t size = random.log_uniform(options.min_size, options.max_size);
+            std::vector<char> data = generate_content(size, options, random);
+
+            fs::path file_path = directory / ("file" + std::to_string(i) + ".bin");
+            std::ofstream outfile(file_path, std::ios::binary);
+            if (!outfile.is_open()) {
+                std::cerr << "Failed to create the file " << file_path << ".\n";
+                return 1;
+            }
+            outfile.write(data.data(), data.size());
+            if (!outfile) {
+                std::cerr << "Failed to write the file " << file_path << ".\n";
+                return 1;
+            }
+            total_bytes += data.size();
+        }
+
+        std::cout << "Created " << options.files << " files (" << total_bytes << " bytes) in "
+                  << directories.size() << " directories under " << options.output.string()
+                  << " with seed " << options.seed << ".\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
     return 0;
 }